@@ -0,0 +1,20 @@
+#include <vector>
+
+#include "AST.h"
+
+
+NodeId Ast::addNode(NodeKind kind) {
+  nodes.emplace_back();
+  nodes.back().kind = kind;
+  return nodes.size() - 1;
+}
+
+void Ast::setList(NodeId id, const std::vector<NodeId>& items) {
+  nodes[id].listBegin = lists.size();
+  nodes[id].listSize = items.size();
+  lists.insert(lists.end(), items.begin(), items.end());
+}
+
+bool isExpression(NodeKind kind) {
+  return kind >= NodeKind::Call;
+}
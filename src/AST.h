@@ -0,0 +1,125 @@
+#ifndef AST_H_
+#define AST_H_
+
+#include <vector>
+#include <cstdint>
+
+#include "Type.h"
+#include "Interner.h"
+
+
+// index of a node in its Ast
+using NodeId = uint32_t;
+constexpr NodeId NoNode = UINT32_MAX;
+
+enum class NodeKind : uint8_t {
+  File,
+  Function,
+  Param,
+  Block,
+  If,
+  VarDecl,
+  Assign,
+  Return,
+  ExprStmt,
+
+  Call,
+  Negate,
+  Not,
+  Mul,
+  Div,
+  Add,
+  Sub,
+  Equal,
+  VarRef,
+  IntLiteral,
+  CharLiteral,
+  BoolLiteral,
+  Paren,
+};
+
+// One flat node layout shared by every kind:
+//
+//   kind          name      operands[0..2]          list
+//   File          -         -                       functions
+//   Function      fn name   body                    params
+//   Param         name      -                       -
+//   Block         -         -                       statements
+//   If            -         cond, then, else?       -
+//   VarDecl       name      init?                   -
+//   Assign        name      value                   -
+//   Return        -         value?                  -
+//   ExprStmt      -         expr                    -
+//   Call          -         callee                  args
+//   Negate/Not    -         operand                 -
+//   Paren         -         inner                   -
+//   Mul..Equal    -         lhs, rhs                -
+//   VarRef        name      -                       -
+//   *Literal      -         -                       -      (value holds the parsed literal)
+//
+// else of If is a Block or a nested If. Function, Param and VarDecl carry
+// their declared type in declType when hasDeclType is set.
+struct Node {
+  NodeKind kind;
+  bool hasDeclType = false;
+  PrimitiveKind declType = PrimitiveKind::Int;
+  SymbolId name = NoSymbol;
+  NodeId operands[3] = { NoNode, NoNode, NoNode };
+  uint32_t listBegin = 0;
+  uint32_t listSize = 0;
+  int64_t value = 0;
+};
+
+struct NodeList {
+  const NodeId *first, *last;
+
+  size_t size() const { return last - first; }
+  NodeId operator[](size_t i) const { return first[i]; }
+  const NodeId* begin() const { return first; }
+  const NodeId* end() const { return last; }
+};
+
+// Program lowered from the parse tree. Nodes and child lists live in two
+// flat arrays and refer to each other by index.
+class Ast {
+ public:
+  std::vector<Node> nodes;
+  std::vector<NodeId> lists;
+  NodeId root = NoNode;
+
+  NodeId addNode(NodeKind kind);
+  void setList(NodeId id, const std::vector<NodeId>& items);
+
+  Node& operator[](NodeId id) { return nodes[id]; }
+  const Node& operator[](NodeId id) const { return nodes[id]; }
+  size_t size() const { return nodes.size(); }
+
+  NodeList list(NodeId id) const {
+    const Node& node = nodes[id];
+    return NodeList{ lists.data() + node.listBegin, lists.data() + node.listBegin + node.listSize };
+  }
+};
+
+// Per-node annotation (scope, inferred type, ...) stored densely and
+// indexed by NodeId, in place of a hash map keyed by node.
+template <typename T>
+class NodeTable {
+ public:
+  NodeTable() {}
+  NodeTable(const Ast& ast, T _fill) : values(ast.size(), _fill), fill(_fill) {}
+
+  T& operator[](NodeId id) { return values[id]; }
+  const T& operator[](NodeId id) const { return values[id]; }
+  size_t size() const { return values.size(); }
+
+  // covers nodes appended to the Ast after the table was built
+  void grow(const Ast& ast) { values.resize(ast.size(), fill); }
+
+ private:
+  std::vector<T> values;
+  T fill = T();
+};
+
+bool isExpression(NodeKind kind);
+
+#endif
@@ -0,0 +1,444 @@
+#include <string>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <sstream>
+#include <unordered_map>
+
+#include "Type.h"
+#include "AST.h"
+#include "SymbolTable.h"
+#include "Compilation.h"
+#include "Bytecode.h"
+
+
+uint32_t BytecodeProgram::findFunction(const std::string& name) const {
+  auto it = functionIndex.find(name);
+  return (it != functionIndex.end()) ? it->second : NoFunction;
+}
+
+static const char* opcodeName(Opcode op) {
+  switch (op) {
+    case Opcode::Move: return "move";
+    case Opcode::LoadConst: return "const";
+    case Opcode::Add: return "add";
+    case Opcode::Sub: return "sub";
+    case Opcode::Mul: return "mul";
+    case Opcode::Div: return "div";
+    case Opcode::Negate: return "neg";
+    case Opcode::Not: return "not";
+    case Opcode::Equal: return "eq";
+    case Opcode::TruncChar: return "truncchar";
+    case Opcode::Jump: return "jump";
+    case Opcode::JumpIfFalse: return "jumpifnot";
+    case Opcode::Call: return "call";
+    case Opcode::Return: return "ret";
+  }
+  return "?";
+}
+
+std::string BytecodeProgram::disassemble() const {
+  std::ostringstream oss;
+  for (auto& function : functions) {
+    oss << function.name << ": " << function.registerCount << " registers\n";
+    uint32_t end = (&function == &functions.back()) ? code.size() : (&function)[1].entry;
+    for (uint32_t pc = function.entry; pc < end; pc++) {
+      const Instruction& ins = code[pc];
+      oss << "  " << pc << "\t" << opcodeName(ins.op) << "\t";
+      switch (ins.op) {
+        case Opcode::LoadConst:
+          oss << "r" << ins.a << ", " << constants[ins.wide()];
+          break;
+        case Opcode::Jump:
+          oss << ins.wide();
+          break;
+        case Opcode::JumpIfFalse:
+          oss << "r" << ins.a << ", " << ins.wide();
+          break;
+        case Opcode::Call:
+          oss << "r" << ins.a << ", " << functions[ins.wide()].name;
+          break;
+        case Opcode::Return:
+        case Opcode::TruncChar:
+          oss << "r" << ins.a;
+          break;
+        case Opcode::Move:
+        case Opcode::Negate:
+        case Opcode::Not:
+          oss << "r" << ins.a << ", r" << ins.b;
+          break;
+        default:
+          oss << "r" << ins.a << ", r" << ins.b << ", r" << ins.c;
+          break;
+      }
+      oss << "\n";
+    }
+  }
+  return oss.str();
+}
+
+
+namespace {
+
+// Emits one function at a time. Every variable of a function keeps a
+// register of its own, numbered after the parameters; temporaries are
+// stacked above them and released at the end of each statement.
+class BytecodeCompiler {
+ public:
+  BytecodeCompiler(CompilationContext& _context, BytecodeProgram& _program, std::string& _error)
+    : context(_context), ast(_context.ast), scopeTable(_context.scopeTable), program(_program), error(_error) {}
+
+  bool compile() {
+    rootScope = context.scopes[ast.root];
+    NodeList funcs = ast.list(ast.root);
+    for (uint32_t i = 0; i < funcs.size(); i++) {
+      // the first declaration wins on a collision, as in the symbol table
+      functionOf.emplace(ast[funcs[i]].name, i);
+      program.functionIndex.emplace(context.names.name(ast[funcs[i]].name), i);
+    }
+    for (auto func : funcs) {
+      compileFunction(func);
+    }
+    return error.empty();
+  }
+
+ private:
+  static constexpr uint32_t MaxRegisters = UINT16_MAX;
+
+  CompilationContext& context;
+  const Ast& ast;
+  ScopeTable& scopeTable;
+  BytecodeProgram& program;
+  std::string& error;
+
+  ScopeId rootScope;
+  std::unordered_map<SymbolId, uint32_t> functionOf;
+  std::unordered_map<int64_t, uint32_t> constantIndex;
+
+  // registers of the current function, keyed by declaring scope and name
+  std::unordered_map<uint64_t, uint16_t> variables;
+  ScopeId currentScope;
+  uint32_t variableCount;
+  uint32_t tempTop;
+  uint32_t registerCount;
+
+  void fail(const std::string& message) {
+    if (error.empty()) {
+      error = message;
+    }
+  }
+
+  static uint64_t variableKey(ScopeId scope, SymbolId name) {
+    return (uint64_t(scope) << 32) | name;
+  }
+
+  uint16_t allocate() {
+    if (tempTop >= MaxRegisters) {
+      fail("a function needs too many registers");
+      return 0;
+    }
+    registerCount = std::max(registerCount, tempTop + 1);
+    return tempTop++;
+  }
+
+  bool isTemp(uint16_t reg) const { return reg >= variableCount; }
+
+  uint32_t emit(Opcode op, uint16_t a = 0, uint16_t b = 0, uint16_t c = 0) {
+    Instruction ins;
+    ins.op = op;
+    ins.a = a;
+    ins.b = b;
+    ins.c = c;
+    program.code.push_back(ins);
+    return program.code.size() - 1;
+  }
+
+  uint32_t emitWide(Opcode op, uint16_t a, uint32_t wide) {
+    uint32_t at = emit(op, a);
+    program.code[at].setWide(wide);
+    return at;
+  }
+
+  void patchTarget(uint32_t jump) {
+    program.code[jump].setWide(program.code.size());
+  }
+
+  void loadConstant(uint16_t reg, int64_t value) {
+    auto it = constantIndex.find(value);
+    if (it == constantIndex.end()) {
+      it = constantIndex.emplace(value, program.constants.size()).first;
+      program.constants.push_back(value);
+    }
+    emitWide(Opcode::LoadConst, reg, it->second);
+  }
+
+  // kind of a resolved type; open types hold no value anyone can observe,
+  // so they are treated as int
+  PrimitiveKind kindOf(Type *type) {
+    auto *concrete = type->resolved()->as<ConcreteType>();
+    if (concrete == nullptr) {
+      if (type->resolved()->as<FunctionType>() != nullptr) {
+        fail("function values are not supported by the VM");
+      }
+      return PrimitiveKind::Int;
+    }
+    if (concrete->primitive == PrimitiveKind::Float) {
+      fail("float values are not supported by the VM");
+    }
+    return concrete->primitive;
+  }
+
+  void compileFunction(NodeId node) {
+    const Node& func = ast[node];
+    auto *signature = scopeTable.findSymbol(rootScope, func.name)->resolved()->as<FunctionType>();
+
+    BytecodeFunction function;
+    function.name = context.names.name(func.name);
+    function.entry = program.code.size();
+    for (auto *param : signature->from) {
+      function.params.push_back(kindOf(param));
+    }
+    function.result = kindOf(signature->to);
+
+    // parameters come first so a call can pass them in place
+    variables.clear();
+    ScopeId functionScope = context.scopes[node];
+    uint32_t next = 0;
+    for (auto& symbol : scopeTable[functionScope].symbols) {
+      variables[variableKey(functionScope, symbol.name)] = next++;
+    }
+    // locals sharing a coalesced slot share its register
+    std::vector<const Symbol*> shared;
+    std::vector<ScopeId> sharedScopes;
+    std::queue<ScopeId> q;
+    q.push(context.scopes[func.operands[0]]);
+    while (!q.empty()) {
+      ScopeId scope = q.front();
+      q.pop();
+      for (auto& symbol : scopeTable[scope].symbols) {
+        kindOf(symbol.type);
+        if (symbol.storageScope != NoScope) {
+          shared.push_back(&symbol);
+          sharedScopes.push_back(scope);
+          continue;
+        }
+        variables[variableKey(scope, symbol.name)] = next++;
+      }
+      for (auto child : scopeTable[scope].children) {
+        q.push(child);
+      }
+    }
+    for (size_t i = 0; i < shared.size(); i++) {
+      variables[variableKey(sharedScopes[i], shared[i]->name)] =
+        variables[variableKey(shared[i]->storageScope, shared[i]->storageName)];
+    }
+    if (next > MaxRegisters) {
+      fail("function " + function.name + " has too many variables");
+      next = MaxRegisters;
+    }
+    variableCount = tempTop = registerCount = next;
+
+    currentScope = functionScope;
+    visit(func.operands[0]);
+    // falling off the end returns 0, whatever the result type
+    tempTop = variableCount;
+    uint16_t zero = allocate();
+    loadConstant(zero, 0);
+    emit(Opcode::Return, zero);
+
+    function.registerCount = std::max<uint32_t>(registerCount, 1);
+    program.functions.push_back(std::move(function));
+  }
+
+  void visit(NodeId node) {
+    const Node& n = ast[node];
+    tempTop = variableCount;
+    switch (n.kind) {
+      case NodeKind::Block:
+        currentScope = context.scopes[node];
+        for (auto stmt : ast.list(node)) {
+          visit(stmt);
+        }
+        currentScope = scopeTable[currentScope].parent;
+        break;
+
+      case NodeKind::If: {
+        currentScope = context.scopes[node];
+        uint16_t cond = compileExpr(n.operands[0]);
+        uint32_t skipThen = emitWide(Opcode::JumpIfFalse, cond, 0);
+        visit(n.operands[1]);
+        if (n.operands[2] != NoNode) {
+          uint32_t skipElse = emitWide(Opcode::Jump, 0, 0);
+          patchTarget(skipThen);
+          visit(n.operands[2]);
+          patchTarget(skipElse);
+        }
+        else {
+          patchTarget(skipThen);
+        }
+        currentScope = scopeTable[currentScope].parent;
+        break;
+      }
+
+      case NodeKind::VarDecl:
+        if (n.operands[0] == NoNode) {
+          loadConstant(variable(n.name), 0);
+          break;
+        }
+        // fall through
+      case NodeKind::Assign:
+        narrow(n.operands[0], compileExpr(n.operands[0], variable(n.name)));
+        break;
+
+      case NodeKind::Return:
+        if (n.operands[0] != NoNode) {
+          uint16_t reg = compileExpr(n.operands[0]);
+          narrow(n.operands[0], reg);
+          emit(Opcode::Return, reg);
+        }
+        else {
+          uint16_t zero = allocate();
+          loadConstant(zero, 0);
+          emit(Opcode::Return, zero);
+        }
+        break;
+
+      case NodeKind::ExprStmt:
+        compileExpr(n.operands[0]);
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  uint16_t variable(SymbolId name) {
+    ScopeId scope = scopeTable.resolveScope(currentScope, name);
+    auto it = variables.find(variableKey(scope, name));
+    if (it == variables.end()) {
+      fail("the VM can't use " + context.names.name(name) + " as a value");
+      return 0;
+    }
+    return it->second;
+  }
+
+  // register holding the value of an expression; target, when given, is
+  // where the caller wants it
+  uint16_t compileExpr(NodeId node, int target = -1) {
+    const Node& n = ast[node];
+    auto destination = [&](uint16_t operand) -> uint16_t {
+      if (target >= 0) return target;
+      return isTemp(operand) ? operand : allocate();
+    };
+
+    switch (n.kind) {
+      case NodeKind::IntLiteral:
+      case NodeKind::CharLiteral:
+      case NodeKind::BoolLiteral: {
+        uint16_t dest = (target >= 0) ? target : allocate();
+        // int literals are truncated like a C int constant
+        loadConstant(dest, (n.kind == NodeKind::IntLiteral) ? int64_t(int32_t(n.value)) : n.value);
+        return dest;
+      }
+
+      case NodeKind::VarRef: {
+        uint16_t reg = variable(n.name);
+        if (target >= 0 && target != reg) {
+          emit(Opcode::Move, target, reg);
+          return target;
+        }
+        return reg;
+      }
+
+      case NodeKind::Paren:
+        return compileExpr(n.operands[0], target);
+
+      case NodeKind::Negate:
+      case NodeKind::Not: {
+        uint16_t operand = compileExpr(n.operands[0]);
+        uint16_t dest = destination(operand);
+        emit((n.kind == NodeKind::Negate) ? Opcode::Negate : Opcode::Not, dest, operand);
+        return dest;
+      }
+
+      case NodeKind::Mul:
+      case NodeKind::Div:
+      case NodeKind::Add:
+      case NodeKind::Sub:
+      case NodeKind::Equal: {
+        uint16_t lhs = compileExpr(n.operands[0]);
+        uint16_t rhs = compileExpr(n.operands[1]);
+        uint16_t dest = destination(isTemp(lhs) ? lhs : rhs);
+        emit(binaryOpcode(n.kind), dest, lhs, rhs);
+        return dest;
+      }
+
+      case NodeKind::Call: {
+        const Node& callee = ast[n.operands[0]];
+        auto it = functionOf.end();
+        if (callee.kind == NodeKind::VarRef && scopeTable.resolveScope(currentScope, callee.name) == rootScope) {
+          it = functionOf.find(callee.name);
+        }
+        if (it == functionOf.end()) {
+          fail("the VM only calls top-level functions by name");
+          return 0;
+        }
+
+        // arguments go to consecutive registers, where the callee's frame begins
+        uint16_t base = tempTop;
+        auto args = ast.list(node);
+        for (uint32_t i = 0; i < args.size(); i++) {
+          tempTop = base + i;
+          uint16_t arg = allocate();
+          narrow(args[i], compileExpr(args[i], arg));
+        }
+        tempTop = base;
+        allocate();
+        emitWide(Opcode::Call, base, it->second);
+        if (target >= 0 && target != base) {
+          emit(Opcode::Move, target, base);
+          return target;
+        }
+        return base;
+      }
+
+      default:
+        fail("unexpected expression node");
+        return 0;
+    }
+  }
+
+  static Opcode binaryOpcode(NodeKind kind) {
+    switch (kind) {
+      case NodeKind::Mul: return Opcode::Mul;
+      case NodeKind::Div: return Opcode::Div;
+      case NodeKind::Add: return Opcode::Add;
+      case NodeKind::Sub: return Opcode::Sub;
+      default: return Opcode::Equal;
+    }
+  }
+
+  // C computes char operators in int and narrows the result only where it
+  // is stored to a char, returned or passed, which is where expr is used.
+  // Variables, literals and call results are already narrow.
+  void narrow(NodeId expr, uint16_t reg) {
+    while (ast[expr].kind == NodeKind::Paren) {
+      expr = ast[expr].operands[0];
+    }
+    NodeKind kind = ast[expr].kind;
+    bool arithmetic = (kind == NodeKind::Mul || kind == NodeKind::Div || kind == NodeKind::Add ||
+                       kind == NodeKind::Sub || kind == NodeKind::Negate);
+    if (arithmetic && kindOf(context.nodeTypes[expr]) == PrimitiveKind::Char) {
+      emit(Opcode::TruncChar, reg);
+    }
+  }
+};
+
+}  // namespace
+
+
+bool compileBytecode(CompilationContext& context, BytecodeProgram& program, std::string& error) {
+  program = BytecodeProgram();
+  BytecodeCompiler compiler(context, program, error);
+  return compiler.compile();
+}
@@ -0,0 +1,93 @@
+#ifndef BYTECODE_H_
+#define BYTECODE_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "Type.h"
+#include "HMTypeInference.h"
+
+class CompilationContext;
+
+
+// Instructions of the register machine. Registers are numbered from the
+// base of the running function's frame and hold int, bool and char values
+// alike; the opcode decides how the bits are read.
+//
+//   Move         a = b
+//   LoadConst    a = constants[wide]
+//   Add..Div     a = b op c          32-bit int arithmetic, wrapping like C int
+//   Negate       a = -b
+//   Not          a = !b
+//   Equal        a = (b == c)
+//   TruncChar    a = (char)a         where a char operator result is stored,
+//                                    returned or passed; operands of == and
+//                                    other operators keep the int value
+//   Jump         goto wide
+//   JumpIfFalse  if (!a) goto wide   jump targets are indexes into code
+//   Call         a = functions[wide](a, a + 1, ...)
+//                the callee's frame starts at register a, so arguments
+//                are passed in place and the result replaces the first
+//   Return       return a
+enum class Opcode : uint8_t {
+  Move,
+  LoadConst,
+  Add,
+  Sub,
+  Mul,
+  Div,
+  Negate,
+  Not,
+  Equal,
+  TruncChar,
+  Jump,
+  JumpIfFalse,
+  Call,
+  Return,
+};
+
+struct Instruction {
+  Opcode op;
+  uint16_t a = 0, b = 0, c = 0;
+
+  // b and c read as one 32-bit operand
+  uint32_t wide() const { return uint32_t(b) | (uint32_t(c) << 16); }
+  void setWide(uint32_t value) {
+    b = value & 0xFFFF;
+    c = value >> 16;
+  }
+};
+
+struct BytecodeFunction {
+  std::string name;
+  std::vector<PrimitiveKind> params;
+  PrimitiveKind result;
+  // index of the first instruction in BytecodeProgram::code
+  uint32_t entry;
+  // registers the frame needs, parameters first
+  uint32_t registerCount;
+};
+
+// Code of every top-level function of a type-checked file.
+struct BytecodeProgram {
+  std::vector<Instruction> code;
+  std::vector<int64_t> constants;
+  std::vector<BytecodeFunction> functions;
+  std::unordered_map<std::string, uint32_t> functionIndex;
+
+  // NoFunction when the program has no function of that name
+  uint32_t findFunction(const std::string& name) const;
+
+  // one instruction per line, for debugging
+  std::string disassemble() const;
+};
+
+// Translates an inferred context. False with a message in error when the
+// program uses what the VM does not run: float values, or calls through
+// anything but a top-level function name.
+bool compileBytecode(CompilationContext& context, BytecodeProgram& program, std::string& error);
+
+#endif
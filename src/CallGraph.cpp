@@ -0,0 +1,67 @@
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+
+#include "CallGraph.h"
+
+
+// Iterative Tarjan. A component is completed only after everything
+// reachable from it, so components come out callees first.
+CallGraph::CallGraph(std::vector<std::vector<uint32_t>> _callees)
+  : callees(std::move(_callees)), componentOf(callees.size(), UINT32_MAX) {
+  constexpr uint32_t Unvisited = UINT32_MAX;
+  size_t count = callees.size();
+  std::vector<uint32_t> index(count, Unvisited), lowlink(count);
+  std::vector<bool> onStack(count, false);
+  std::vector<uint32_t> stack;
+  // function being visited and the next of its edges to follow
+  std::vector<std::pair<uint32_t, uint32_t>> frames;
+  uint32_t counter = 0;
+
+  auto enter = [&](uint32_t f) {
+    index[f] = lowlink[f] = counter++;
+    stack.push_back(f);
+    onStack[f] = true;
+    frames.emplace_back(f, 0);
+  };
+
+  for (uint32_t root = 0; root < count; root++) {
+    if (index[root] != Unvisited) {
+      continue;
+    }
+    enter(root);
+    while (!frames.empty()) {
+      uint32_t f = frames.back().first;
+      uint32_t edge = frames.back().second;
+      if (edge < callees[f].size()) {
+        frames.back().second++;
+        uint32_t callee = callees[f][edge];
+        if (index[callee] == Unvisited) {
+          enter(callee);
+        }
+        else if (onStack[callee]) {
+          lowlink[f] = std::min(lowlink[f], index[callee]);
+        }
+        continue;
+      }
+
+      frames.pop_back();
+      if (!frames.empty()) {
+        uint32_t caller = frames.back().first;
+        lowlink[caller] = std::min(lowlink[caller], lowlink[f]);
+      }
+      if (lowlink[f] == index[f]) {
+        components.emplace_back();
+        uint32_t member;
+        do {
+          member = stack.back();
+          stack.pop_back();
+          onStack[member] = false;
+          componentOf[member] = components.size() - 1;
+          components.back().push_back(member);
+        } while (member != f);
+      }
+    }
+  }
+}
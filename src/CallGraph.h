@@ -0,0 +1,23 @@
+#ifndef CALL_GRAPH_H_
+#define CALL_GRAPH_H_
+
+#include <vector>
+#include <cstdint>
+
+
+// Strongly connected components of the call graph between the top-level
+// functions of a file. Functions are numbered by their position in the file.
+class CallGraph {
+ public:
+  explicit CallGraph(std::vector<std::vector<uint32_t>> _callees);
+
+  // functions referenced by each function, possibly with repeats
+  std::vector<std::vector<uint32_t>> callees;
+
+  // components in dependency order: every component comes after the
+  // components it calls, so they can be processed front to back
+  std::vector<std::vector<uint32_t>> components;
+  std::vector<uint32_t> componentOf;
+};
+
+#endif
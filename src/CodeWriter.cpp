@@ -0,0 +1,109 @@
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <cerrno>
+
+#include <unistd.h>
+
+#include "CodeWriter.h"
+
+
+static bool writeAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t n = ::write(fd, data.data(), data.size());
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data.remove_prefix(n);
+  }
+  return true;
+}
+
+
+void StringSink::write(std::string& block) {
+  if (text.empty()) {
+    text.swap(block);
+  }
+  else {
+    text.append(block);
+  }
+  block.clear();
+}
+
+
+FdSink::~FdSink() {
+  if (writer.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    changed.notify_all();
+    writer.join();
+  }
+}
+
+void FdSink::waitIdle(std::unique_lock<std::mutex>& lock) {
+  changed.wait(lock, [this] { return !hasPending; });
+}
+
+void FdSink::write(std::string& block) {
+  std::unique_lock<std::mutex> lock(mutex);
+  if (!writer.joinable()) {
+    writer = std::thread(&FdSink::run, this);
+  }
+  waitIdle(lock);
+  if (!error) {
+    // the writer gets the full block, the caller the drained one
+    pending.swap(block);
+    hasPending = true;
+    changed.notify_all();
+  }
+  block.clear();
+}
+
+void FdSink::flush(std::string& block) {
+  std::unique_lock<std::mutex> lock(mutex);
+  waitIdle(lock);
+  if (!error && !writeAll(fd, block)) {
+    error = true;
+  }
+  block.clear();
+}
+
+bool FdSink::failed() {
+  std::unique_lock<std::mutex> lock(mutex);
+  waitIdle(lock);
+  return error;
+}
+
+void FdSink::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    changed.wait(lock, [this] { return hasPending || stopping; });
+    if (!hasPending) {
+      return;
+    }
+    lock.unlock();
+    bool ok = writeAll(fd, pending);
+    lock.lock();
+    error = error || !ok;
+    pending.clear();
+    hasPending = false;
+    changed.notify_all();
+  }
+}
+
+
+CodeWriter& CodeWriter::indent(int level) {
+  static const std::string spaces(64, ' ');
+  size_t count = level * 2;
+  while (count > 0) {
+    size_t n = std::min(count, spaces.size());
+    *this << std::string_view(spaces.data(), n);
+    count -= n;
+  }
+  return *this;
+}
@@ -0,0 +1,117 @@
+#ifndef CODE_WRITER_H_
+#define CODE_WRITER_H_
+
+#include <string>
+#include <string_view>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <charconv>
+#include <cstdint>
+
+
+// Destination of the blocks a CodeWriter fills. Both calls take the block
+// by reference and leave it empty, possibly with the capacity of an
+// earlier block, so the writer refills the same memory.
+class OutputSink {
+ public:
+  virtual ~OutputSink() {}
+
+  // a full block; the sink may still be writing it when this returns
+  virtual void write(std::string& block) = 0;
+
+  // the last data written so far; everything is in place when this returns
+  virtual void flush(std::string& block) = 0;
+};
+
+// Appends to a string.
+class StringSink : public OutputSink {
+ public:
+  explicit StringSink(std::string& _text) : text(_text) {}
+
+  void write(std::string& block) override;
+  void flush(std::string& block) override { write(block); }
+
+ private:
+  std::string& text;
+};
+
+// Writes to a file descriptor. Full blocks are written by a background
+// thread, started by the first one, while the caller fills the next block.
+// The descriptor is not closed.
+class FdSink : public OutputSink {
+ public:
+  explicit FdSink(int _fd) : fd(_fd) {}
+  ~FdSink();
+  FdSink(const FdSink&) = delete;
+  FdSink& operator=(const FdSink&) = delete;
+
+  void write(std::string& block) override;
+  void flush(std::string& block) override;
+
+  // true once a write has failed; later data is dropped
+  bool failed();
+
+ private:
+  int fd;
+  std::thread writer;
+  std::mutex mutex;
+  std::condition_variable changed;
+  // block handed to the writer thread
+  std::string pending;
+  bool hasPending = false;
+  bool stopping = false;
+  bool error = false;
+
+  void waitIdle(std::unique_lock<std::mutex>& lock);
+  void run();
+};
+
+// Text output of the code generator. Text is gathered in a block of
+// blockSize bytes and handed to the sink whenever the block fills.
+class CodeWriter {
+ public:
+  explicit CodeWriter(OutputSink& _sink, size_t _blockSize = 256 * 1024) : sink(_sink), blockSize(_blockSize) {
+    block.reserve(blockSize + blockSize / 4);
+  }
+  ~CodeWriter() { flush(); }
+  CodeWriter(const CodeWriter&) = delete;
+  CodeWriter& operator=(const CodeWriter&) = delete;
+
+  CodeWriter& operator<<(std::string_view text) {
+    block.append(text);
+    if (block.size() >= blockSize) {
+      written += block.size();
+      sink.write(block);
+    }
+    return *this;
+  }
+  CodeWriter& operator<<(const char *text) { return *this << std::string_view(text); }
+  CodeWriter& operator<<(const std::string& text) { return *this << std::string_view(text); }
+  CodeWriter& operator<<(char c) { return *this << std::string_view(&c, 1); }
+  CodeWriter& operator<<(int64_t value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    return *this << std::string_view(digits, result.ptr - digits);
+  }
+
+  // two spaces per level
+  CodeWriter& indent(int level);
+
+  // hands everything written so far to the sink
+  void flush() {
+    written += block.size();
+    sink.flush(block);
+  }
+
+  // bytes handed to the sink so far
+  size_t bytesWritten() const { return written; }
+
+ private:
+  OutputSink& sink;
+  size_t blockSize;
+  std::string block;
+  size_t written = 0;
+};
+
+#endif
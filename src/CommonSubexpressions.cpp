@@ -0,0 +1,395 @@
+#include "CommonSubexpressions.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+
+static bool isCommutative(NodeKind kind) {
+  return kind == NodeKind::Add || kind == NodeKind::Mul || kind == NodeKind::Equal;
+}
+
+void CommonSubexpressionEliminator::visit(NodeId node) {
+  // rewriting appends lists, so the function list is copied first
+  NodeList list = ast.list(node);
+  std::vector<NodeId> funcs(list.begin(), list.end());
+  // a node is only read once numbered for its own function
+  values = NodeTable<uint32_t>(ast, NoValue);
+  for (auto func : funcs) {
+    numbers.clear();
+    operandsOf.clear();
+    takenNames.clear();
+    collectNames(func);
+    currentScope = scopes[func];
+    visitRegion(ast[func].operands[0], Versions(), Available());
+  }
+}
+
+void CommonSubexpressionEliminator::visitRegion(NodeId block, const Versions& versions, const Available& available) {
+  ScopeId saved = currentScope;
+  currentScope = scopes[block];
+  NodeList list = ast.list(block);
+  std::vector<NodeId> original(list.begin(), list.end());
+
+  std::unordered_map<uint32_t, size_t> counts;
+  Versions counted = versions;
+  std::vector<uint64_t> assigned;
+  for (auto stmt : original) {
+    countStatement(stmt, counted, &counts, true, assigned);
+  }
+
+  // an expression inside a repeated one is computed once with it; larger
+  // values are numbered later, so they come first here
+  std::vector<uint32_t> repeated;
+  for (auto& entry : counts) {
+    if (entry.second >= 2) {
+      repeated.push_back(entry.first);
+    }
+  }
+  std::sort(repeated.begin(), repeated.end(), [](uint32_t a, uint32_t b) { return a > b; });
+  for (auto value : repeated) {
+    size_t saving = counts[value];
+    if (saving < 2) {
+      continue;
+    }
+    for (auto operand : operandsOf[value]) {
+      auto it = counts.find(operand);
+      if (it != counts.end()) {
+        it->second -= std::min(it->second, saving - 1);
+      }
+    }
+  }
+
+  Versions current = versions;
+  Available local = available;
+  std::vector<NodeId> statements;
+  for (auto stmt : original) {
+    std::vector<NodeId> definitions;
+    switch (ast[stmt].kind) {
+      case NodeKind::VarDecl:
+      case NodeKind::Assign:
+      case NodeKind::Return:
+      case NodeKind::ExprStmt:
+        if (ast[stmt].operands[0] != NoNode) {
+          NodeId value = rewrite(ast[stmt].operands[0], &counts, local, currentScope, definitions);
+          ast[stmt].operands[0] = value;
+        }
+        break;
+
+      case NodeKind::If: {
+        NodeId condition = rewrite(ast[stmt].operands[0], &counts, local, currentScope, definitions);
+        ast[stmt].operands[0] = condition;
+        ScopeId outer = currentScope;
+        currentScope = scopes[stmt];
+        visitRegion(ast[stmt].operands[1], current, local);
+        if (ast[stmt].operands[2] != NoNode) {
+          rewriteNested(ast[stmt].operands[2], current, local);
+        }
+        currentScope = outer;
+        break;
+      }
+
+      case NodeKind::Block:
+        visitRegion(stmt, current, local);
+        break;
+
+      default:
+        break;
+    }
+    statements.insert(statements.end(), definitions.begin(), definitions.end());
+    statements.push_back(stmt);
+    countStatement(stmt, current, nullptr, false, assigned);
+  }
+  if (statements.size() != original.size()) {
+    ast.setList(block, statements);
+  }
+
+  currentScope = saved;
+}
+
+// an else branch, which can only use what is computed before its if
+void CommonSubexpressionEliminator::rewriteNested(NodeId node, const Versions& versions, const Available& available) {
+  if (ast[node].kind == NodeKind::Block) {
+    visitRegion(node, versions, available);
+    return;
+  }
+  ScopeId saved = currentScope;
+  currentScope = scopes[node];
+  Available local = available;
+  std::vector<NodeId> none;
+  NodeId condition = rewrite(ast[node].operands[0], nullptr, local, currentScope, none);
+  ast[node].operands[0] = condition;
+  visitRegion(ast[node].operands[1], versions, available);
+  if (ast[node].operands[2] != NoNode) {
+    rewriteNested(ast[node].operands[2], versions, available);
+  }
+  currentScope = saved;
+}
+
+void CommonSubexpressionEliminator::countStatement(NodeId node, Versions& versions,
+                                                   std::unordered_map<uint32_t, size_t>* counts, bool anchor,
+                                                   std::vector<uint64_t>& assigned) {
+  const Node& n = ast[node];
+  // a local assigned inside a block or if gets a version naming the join
+  auto join = [&](const std::vector<uint64_t>& inner) {
+    for (auto key : inner) {
+      versions[key] = (1ull << 63) | node;
+    }
+    assigned.insert(assigned.end(), inner.begin(), inner.end());
+  };
+
+  switch (n.kind) {
+    case NodeKind::Block: {
+      ScopeId saved = currentScope;
+      currentScope = scopes[node];
+      Versions inside = versions;
+      std::vector<uint64_t> inner;
+      for (auto stmt : ast.list(node)) {
+        countStatement(stmt, inside, counts, false, inner);
+      }
+      currentScope = saved;
+      join(inner);
+      break;
+    }
+
+    case NodeKind::If: {
+      ScopeId saved = currentScope;
+      currentScope = scopes[node];
+      if (counts != nullptr) {
+        number(n.operands[0], versions);
+        count(n.operands[0], *counts, anchor);
+      }
+      std::vector<uint64_t> inner;
+      Versions branch = versions;
+      countStatement(n.operands[1], branch, counts, false, inner);
+      if (n.operands[2] != NoNode) {
+        branch = versions;
+        countStatement(n.operands[2], branch, counts, false, inner);
+      }
+      currentScope = saved;
+      join(inner);
+      break;
+    }
+
+    case NodeKind::VarDecl:
+    case NodeKind::Assign:
+    case NodeKind::Return:
+    case NodeKind::ExprStmt: {
+      if (counts != nullptr && n.operands[0] != NoNode) {
+        number(n.operands[0], versions);
+        count(n.operands[0], *counts, anchor);
+      }
+      if (n.kind == NodeKind::VarDecl || n.kind == NodeKind::Assign) {
+        ScopeId scope = (n.kind == NodeKind::VarDecl) ? currentScope : scopeTable.resolveScope(currentScope, n.name);
+        uint64_t key = symbolKey(scope, n.name);
+        versions[key] = uint64_t(node) + 1;
+        assigned.push_back(key);
+      }
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+uint32_t CommonSubexpressionEliminator::number(NodeId node, const Versions& versions) {
+  if (node >= values.size()) {
+    values.grow(ast);
+  }
+  const Node& n = ast[node];
+  ValueKey key{ n.kind, 0, 0 };
+  std::vector<uint32_t> operands;
+  switch (n.kind) {
+    case NodeKind::VarRef: {
+      ScopeId scope = scopeTable.resolveScope(currentScope, n.name);
+      if (scope == NoScope || scopeTable[scope].kind == ROOT) {
+        return values[node] = NoValue;
+      }
+      key.first = symbolKey(scope, n.name);
+      auto it = versions.find(key.first);
+      key.second = (it != versions.end()) ? it->second : 0;
+      break;
+    }
+
+    case NodeKind::IntLiteral:
+    case NodeKind::CharLiteral:
+    case NodeKind::BoolLiteral:
+      key.first = static_cast<uint64_t>(n.value);
+      break;
+
+    case NodeKind::Paren:
+      return values[node] = number(n.operands[0], versions);
+
+    case NodeKind::Call:
+      for (auto arg : ast.list(node)) {
+        number(arg, versions);
+      }
+      return values[node] = NoValue;
+
+    case NodeKind::Negate:
+    case NodeKind::Not: {
+      uint32_t operand = number(n.operands[0], versions);
+      if (operand == NoValue) {
+        return values[node] = NoValue;
+      }
+      key.first = operand;
+      operands.push_back(operand);
+      break;
+    }
+
+    default: {
+      uint32_t left = number(n.operands[0], versions);
+      uint32_t right = number(n.operands[1], versions);
+      if (left == NoValue || right == NoValue) {
+        return values[node] = NoValue;
+      }
+      if (isCommutative(n.kind) && right < left) {
+        std::swap(left, right);
+      }
+      key.first = left;
+      key.second = right;
+      operands.push_back(left);
+      operands.push_back(right);
+      break;
+    }
+  }
+
+  auto inserted = numbers.emplace(key, operandsOf.size());
+  if (inserted.second) {
+    operandsOf.push_back(std::move(operands));
+  }
+  return values[node] = inserted.first->second;
+}
+
+void CommonSubexpressionEliminator::count(NodeId node, std::unordered_map<uint32_t, size_t>& counts, bool anchor) {
+  if (isCandidate(node)) {
+    if (anchor) {
+      counts[values[node]]++;
+    }
+    else {
+      auto it = counts.find(values[node]);
+      if (it != counts.end()) {
+        it->second++;
+      }
+    }
+  }
+  for (auto operand : ast[node].operands) {
+    if (operand != NoNode) {
+      count(operand, counts, anchor);
+    }
+  }
+  for (auto arg : ast.list(node)) {
+    count(arg, counts, anchor);
+  }
+}
+
+bool CommonSubexpressionEliminator::isCandidate(NodeId node) const {
+  switch (ast[node].kind) {
+    case NodeKind::Negate:
+    case NodeKind::Not:
+    case NodeKind::Mul:
+    case NodeKind::Div:
+    case NodeKind::Add:
+    case NodeKind::Sub:
+    case NodeKind::Equal:
+      break;
+    default:
+      return false;
+  }
+  if (node >= values.size() || values[node] == NoValue || nodeTypes[node] == nullptr) {
+    return false;
+  }
+  auto *type = nodeTypes[node]->resolved()->as<ConcreteType>();
+  return type != nullptr && (type->primitive == PrimitiveKind::Int || type->primitive == PrimitiveKind::Bool);
+}
+
+NodeId CommonSubexpressionEliminator::rewrite(NodeId node, const std::unordered_map<uint32_t, size_t>* counts,
+                                              Available& available, ScopeId scope,
+                                              std::vector<NodeId>& definitions) {
+  if (ast[node].kind == NodeKind::Paren) {
+    NodeId inner = rewrite(ast[node].operands[0], counts, available, scope, definitions);
+    if (ast[inner].kind == NodeKind::VarRef) {
+      return inner;
+    }
+    ast[node].operands[0] = inner;
+    return node;
+  }
+
+  bool candidate = isCandidate(node);
+  if (candidate) {
+    auto it = available.find(values[node]);
+    if (it != available.end()) {
+      eliminatedExpressions++;
+      NodeId read = addNode(NodeKind::VarRef, nodeTypes[node]);
+      ast[read].name = it->second;
+      return read;
+    }
+  }
+
+  // operands first, so their locals are declared before this one
+  for (int i = 0; i < 3; i++) {
+    if (ast[node].operands[i] != NoNode) {
+      NodeId operand = rewrite(ast[node].operands[i], counts, available, scope, definitions);
+      ast[node].operands[i] = operand;
+    }
+  }
+  for (uint32_t i = 0; i < ast[node].listSize; i++) {
+    NodeId arg = rewrite(ast.lists[ast[node].listBegin + i], counts, available, scope, definitions);
+    ast.lists[ast[node].listBegin + i] = arg;
+  }
+
+  if (candidate && counts != nullptr) {
+    auto it = counts->find(values[node]);
+    if (it != counts->end() && it->second >= 2) {
+      SymbolId local = freshName();
+      scopeTable.addSymbol(scope, local, nodeTypes[node]);
+      available[values[node]] = local;
+      temporaries++;
+
+      NodeId decl = addNode(NodeKind::VarDecl, nullptr);
+      ast[decl].name = local;
+      ast[decl].operands[0] = node;
+      definitions.push_back(decl);
+      NodeId read = addNode(NodeKind::VarRef, nodeTypes[node]);
+      ast[read].name = local;
+      return read;
+    }
+  }
+  return node;
+}
+
+NodeId CommonSubexpressionEliminator::addNode(NodeKind kind, Type *type) {
+  NodeId id = ast.addNode(kind);
+  scopes.grow(ast);
+  nodeTypes.grow(ast);
+  values.grow(ast);
+  nodeTypes[id] = type;
+  return id;
+}
+
+SymbolId CommonSubexpressionEliminator::freshName() {
+  std::string candidate = "tmp";
+  SymbolId id = names.intern(candidate);
+  for (int k = 2; takenNames.count(id) != 0; k++) {
+    candidate = "tmp_" + std::to_string(k);
+    id = names.intern(candidate);
+  }
+  takenNames.insert(id);
+  return id;
+}
+
+void CommonSubexpressionEliminator::collectNames(NodeId node) {
+  const Node& n = ast[node];
+  if (n.name != NoSymbol) {
+    takenNames.insert(n.name);
+  }
+  for (auto operand : n.operands) {
+    if (operand != NoNode) {
+      collectNames(operand);
+    }
+  }
+  for (auto item : ast.list(node)) {
+    collectNames(item);
+  }
+}
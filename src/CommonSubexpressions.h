@@ -0,0 +1,101 @@
+#ifndef COMMON_SUBEXPRESSIONS_H_
+#define COMMON_SUBEXPRESSIONS_H_
+
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstddef>
+#include <cstdint>
+
+#include "Type.h"
+#include "Interner.h"
+#include "AST.h"
+#include "SymbolTable.h"
+
+
+// Computes each repeated operator expression of a block once, into a new
+// local declared in front of the statement that first needs it. Values are
+// numbered by hash-consing: a local's value is numbered by the statement
+// that last assigned it, so two trees get the same number exactly when
+// they compute the same value, and operands of +, * and == are ordered.
+//
+// The statements of a block are one region. An expression repeated in the
+// region, or repeated after its first occurrence in the blocks nested in
+// it, gets a local; an if only joins the values its branches assign. Only
+// int and bool values are kept in locals, since C computes char operators
+// in int and a char local would truncate them. Calls are never numbered,
+// and neither is anything around them.
+class CommonSubexpressionEliminator {
+ public:
+  CommonSubexpressionEliminator(Ast& _ast, ScopeMap& _scopes, ScopeTable& _scopeTable, Interner& _names,
+                                NodeTable<Type*>& _nodeTypes)
+    : ast(_ast), scopes(_scopes), scopeTable(_scopeTable), names(_names), nodeTypes(_nodeTypes) {}
+
+  Ast& ast;
+  ScopeMap& scopes;
+  ScopeTable& scopeTable;
+  Interner& names;
+  NodeTable<Type*>& nodeTypes;
+  ScopeId currentScope;
+
+  // expressions replaced by a read of a local, and the locals added
+  size_t eliminatedExpressions = 0;
+  size_t temporaries = 0;
+
+  void visit(NodeId node);
+
+ private:
+  static constexpr uint32_t NoValue = UINT32_MAX;
+
+  struct ValueKey {
+    NodeKind kind;
+    uint64_t first, second;
+
+    bool operator==(const ValueKey& other) const {
+      return kind == other.kind && first == other.first && second == other.second;
+    }
+  };
+  struct ValueKeyHash {
+    size_t operator()(const ValueKey& key) const {
+      uint64_t hash = (key.first * 0x9e3779b97f4a7c15ull) ^ (key.second + static_cast<uint64_t>(key.kind));
+      return static_cast<size_t>(hash ^ (hash >> 29));
+    }
+  };
+
+  // version of each local, keyed by declaring scope and name; absent ones
+  // still hold their value from the function's start
+  using Versions = std::unordered_map<uint64_t, uint64_t>;
+  // local holding each value number
+  using Available = std::unordered_map<uint32_t, SymbolId>;
+
+  // numbering of the current function
+  std::unordered_map<ValueKey, uint32_t, ValueKeyHash> numbers;
+  // operator value numbers of the operands of each value number
+  std::vector<std::vector<uint32_t>> operandsOf;
+  NodeTable<uint32_t> values;
+  std::unordered_set<SymbolId> takenNames;
+
+  uint64_t symbolKey(ScopeId scope, SymbolId name) const { return (uint64_t(scope) << 32) | name; }
+
+  void visitRegion(NodeId block, const Versions& versions, const Available& available);
+  // Applies what statement assigns to versions and appends the locals to
+  // assigned. With counts, also numbers its expressions and counts their
+  // values: all of them when anchor is set, else only those counted before.
+  void countStatement(NodeId node, Versions& versions, std::unordered_map<uint32_t, size_t>* counts, bool anchor,
+                      std::vector<uint64_t>& assigned);
+  void rewriteNested(NodeId node, const Versions& versions, const Available& available);
+
+  uint32_t number(NodeId node, const Versions& versions);
+  void count(NodeId node, std::unordered_map<uint32_t, size_t>& counts, bool anchor);
+  bool isCandidate(NodeId node) const;
+  // node or the read of a local replacing it. Values counted at least
+  // twice get a local, declared by a statement appended to definitions.
+  NodeId rewrite(NodeId node, const std::unordered_map<uint32_t, size_t>* counts, Available& available,
+                 ScopeId scope, std::vector<NodeId>& definitions);
+
+  NodeId addNode(NodeKind kind, Type *type);
+  SymbolId freshName();
+  void collectNames(NodeId node);
+};
+
+#endif
@@ -0,0 +1,243 @@
+#include <string>
+#include <string_view>
+#include <utility>
+#include <unordered_set>
+
+#include "Compilation.h"
+#include "TypeEquations.h"
+#include "Transpiler.h"
+#include "Inlining.h"
+#include "ConstantFolding.h"
+#include "CommonSubexpressions.h"
+#include "DeadStoreElimination.h"
+#include "SlotCoalescing.h"
+
+
+bool CompilationContext::parse(std::string_view source, const ParseOptions& options, ParseStats *parseStats) {
+  ParseStats local;
+  if (parseStats == nullptr && stats != nullptr) {
+    parseStats = &local;
+  }
+  ast = parseSource(source, names, options, parseStats);
+  if (stats != nullptr) {
+    stats->addTime("lex", parseStats->lexMillis);
+    stats->addTime("parse", parseStats->parseMillis);
+    stats->count("source bytes", source.size());
+    stats->count("tokens", parseStats->tokens);
+    stats->count("AST nodes", ast.size());
+  }
+  return ast.root != NoNode;
+}
+
+bool CompilationContext::analyze(std::string& error) {
+  std::vector<SymbolId> duplicates;
+  {
+    PhaseTimer timer(stats, "symbol table");
+    SymbolTableGenerator symgen(ast, types, scopeTable);
+    symgen.visit(ast.root);
+    scopes = std::move(symgen.scopes);
+    duplicates = std::move(symgen.duplicateNames);
+  }
+
+  ScopeId root = scopes[ast.root];
+  for (auto& external : externals) {
+    std::vector<Type*> params;
+    for (auto param : external.params) {
+      params.push_back(types.getConcreteType(param));
+    }
+    Type *signature = types.getFunctionType(params, types.getConcreteType(external.result));
+    scopeTable.addSymbol(root, names.intern(external.name), signature);
+  }
+
+  std::vector<SymbolId> undefined;
+  {
+    PhaseTimer timer(stats, "type equations");
+    TypeEquationGenerater eqgen(ast, scopes, scopeTable, types, names);
+    eqgen.visit(ast.root);
+    functions = std::move(eqgen.functions);
+    nodeTypes = std::move(eqgen.nodeTypes);
+    undefined = std::move(eqgen.undefinedNames);
+  }
+
+  if (stats != nullptr) {
+    size_t equations = 0;
+    for (auto& function : functions) {
+      equations += function.equations.size();
+    }
+    stats->count("functions", functions.size());
+    stats->count("scopes", scopeTable.size());
+    stats->count("equations", equations);
+  }
+
+  // a second declaration shadows nothing and would be emitted twice, and an
+  // undefined name leaves its uses unconstrained, so inference can't be trusted
+  auto listNames = [this](const char *title, const std::vector<SymbolId>& list) {
+    std::string text = title;
+    std::unordered_set<SymbolId> reported;
+    for (auto name : list) {
+      if (reported.insert(name).second) {
+        text += " ";
+        text += names.name(name);
+      }
+    }
+    return text;
+  };
+  if (!duplicates.empty()) {
+    error = listNames("names declared twice:", duplicates);
+    return false;
+  }
+  if (!undefined.empty()) {
+    error = listNames("undefined names:", undefined);
+    return false;
+  }
+  return true;
+}
+
+bool CompilationContext::infer(ThreadPool *pool) {
+  bool inferred;
+  {
+    PhaseTimer timer(stats, "unify");
+    inferred = inferTypes(types, functions, pool);
+  }
+  if (stats != nullptr) {
+    // every type var is made before inference; function types may still be
+    // interned while it runs
+    stats->count("type vars", types.typeVarCount());
+    stats->count("function types", types.functionTypeCount());
+    stats->count("type arena bytes", types.bytesAllocated());
+  }
+  return inferred;
+}
+
+void CompilationContext::optimize() {
+  Inliner inliner(ast, scopes, scopeTable, names, nodeTypes, functions);
+  {
+    PhaseTimer timer(stats, "inline");
+    inliner.visit(ast.root);
+  }
+  inlinedFunctions = std::move(inliner.inlinable);
+  helperFunctions = std::move(inliner.helpers);
+  ConstantFolder folder(ast, scopes, scopeTable, nodeTypes);
+  {
+    PhaseTimer timer(stats, "fold constants");
+    folder.visit(ast.root);
+  }
+  CommonSubexpressionEliminator eliminator(ast, scopes, scopeTable, names, nodeTypes);
+  {
+    PhaseTimer timer(stats, "common subexpressions");
+    eliminator.visit(ast.root);
+  }
+  DeadStoreEliminator deadStores(ast, scopes, scopeTable);
+  {
+    PhaseTimer timer(stats, "dead stores");
+    deadStores.visit(ast.root);
+  }
+  SlotCoalescer coalescer(ast, scopes, scopeTable);
+  {
+    PhaseTimer timer(stats, "coalesce slots");
+    coalescer.visit(ast.root);
+  }
+
+  if (stats != nullptr) {
+    stats->count("inlined calls", inliner.inlinedCalls);
+    stats->count("folded expressions", folder.foldedExpressions);
+    stats->count("propagated constants", folder.propagatedConstants);
+    stats->count("pruned ifs", folder.prunedIfs);
+    stats->count("eliminated expressions", eliminator.eliminatedExpressions);
+    stats->count("temporaries", eliminator.temporaries);
+    stats->count("removed stores", deadStores.removedStores);
+    stats->count("removed variables", deadStores.removedVariables);
+    stats->count("shared variables", coalescer.sharedVariables);
+  }
+}
+
+static const char* typeName(Type *type) {
+  auto *concrete = type->resolved()->as<ConcreteType>();
+  return (concrete != nullptr) ? concrete->name() : "?";
+}
+
+std::string CompilationContext::signatures() {
+  std::string text;
+  ScopeId root = scopes[ast.root];
+  for (auto func : ast.list(ast.root)) {
+    auto *signature = scopeTable.findSymbol(root, ast[func].name)->resolved()->as<FunctionType>();
+    text += "fn ";
+    text += names.name(ast[func].name);
+    text += "(";
+    for (size_t i = 0; i < signature->from.size(); i++) {
+      text += typeName(signature->from[i]);
+      if (i + 1 < signature->from.size()) {
+        text += ", ";
+      }
+    }
+    text += "): ";
+    text += typeName(signature->to);
+    text += "\n";
+  }
+  return text;
+}
+
+void CompilationContext::markStaticFunctions(Transpiler& transpiler) {
+  if (!staticInlineHelpers) {
+    return;
+  }
+  NodeList funcs = ast.list(ast.root);
+  for (size_t i = 0; i < helperFunctions.size(); i++) {
+    if (helperFunctions[i]) {
+      transpiler.staticFunctions.insert(funcs[i]);
+    }
+  }
+}
+
+void CompilationContext::transpile(OutputSink& sink) {
+  PhaseTimer timer(stats, "transpile");
+  Transpiler transpiler(ast, scopes, scopeTable, names, sink);
+  markStaticFunctions(transpiler);
+  transpiler.visit(ast.root);
+  transpiler.out.flush();
+  if (stats != nullptr) {
+    stats->count("bytes emitted", transpiler.out.bytesWritten());
+  }
+}
+
+std::string CompilationContext::transpile() {
+  std::string text;
+  StringSink sink(text);
+  transpile(sink);
+  return text;
+}
+
+std::vector<std::string> CompilationContext::transpileFunctions() {
+  std::vector<std::string> code;
+  std::string text;
+  StringSink sink(text);
+  Transpiler transpiler(ast, scopes, scopeTable, names, sink);
+  markStaticFunctions(transpiler);
+  for (auto func : ast.list(ast.root)) {
+    transpiler.visitTopLevelFunction(func);
+    transpiler.out.flush();
+    code.push_back(std::move(text));
+    text.clear();
+  }
+  return code;
+}
+
+
+bool compileSource(std::string_view source, const ParseOptions& options, std::string& output, std::string& error,
+                   ThreadPool *pool) {
+  CompilationContext context;
+  if (!context.parse(source, options)) {
+    error = "Syntax errors...";
+    return false;
+  }
+  if (!context.analyze(error)) {
+    return false;
+  }
+  if (!context.infer(pool)) {
+    error = "Type inference failed...";
+    return false;
+  }
+  context.optimize();
+  output = context.transpile();
+  return true;
+}
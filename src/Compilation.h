@@ -0,0 +1,90 @@
+#ifndef COMPILATION_H_
+#define COMPILATION_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Type.h"
+#include "Interner.h"
+#include "AST.h"
+#include "Lowering.h"
+#include "SymbolTable.h"
+#include "HMTypeInference.h"
+#include "ThreadPool.h"
+#include "CodeWriter.h"
+#include "PassStats.h"
+
+class Transpiler;
+
+
+// function defined outside the parsed source, visible from its root scope
+struct ExternalFunction {
+  std::string name;
+  std::vector<PrimitiveKind> params;
+  PrimitiveKind result;
+};
+
+// Everything one source file owns while it is compiled. Contexts share no
+// state, so separate files can be compiled on separate threads.
+class CompilationContext {
+ public:
+  Interner names;
+  Ast ast;
+  TypeContext types;
+  ScopeTable scopeTable;
+  ScopeMap scopes;
+  // type of every expression node, resolved once infer succeeds
+  NodeTable<Type*> nodeTypes;
+  // equations of each top-level function
+  std::vector<FunctionConstraints> functions;
+  // declared by analyze unless the source defines a function of the same name
+  std::vector<ExternalFunction> externals;
+  // per top-level function, set by optimize: its body was copied into its
+  // callers, and it is still called by another function
+  std::vector<bool> inlinedFunctions;
+  std::vector<bool> helperFunctions;
+  // emit helpers that were not inlined everywhere as static inline, which
+  // leaves them out of the object's exported symbols
+  bool staticInlineHelpers = false;
+  // when set, every phase adds its time and counters to it
+  PassStats *stats = nullptr;
+
+  // false when the source has syntax errors, which are printed
+  bool parse(std::string_view source, const ParseOptions& options, ParseStats *parseStats = nullptr);
+
+  // builds the scopes and collects the type equations. False with a
+  // message in error when a name is declared twice in one scope or is
+  // used with no definition.
+  bool analyze(std::string& error);
+
+  // false when the equations have no solution. Independent functions are
+  // inferred concurrently on pool when one is given.
+  bool infer(ThreadPool *pool = nullptr);
+
+  // inlines small functions, folds constants, computes repeated
+  // expressions once, removes dead stores and coalesces the storage of
+  // locals in the inferred program, before code is generated
+  void optimize();
+
+  // inferred signature of each top-level function in source syntax, one per
+  // line, with ? for a type inference left open
+  std::string signatures();
+
+  // streams the C code of the file to sink
+  void transpile(OutputSink& sink);
+  std::string transpile();
+  // C code of each top-level function, in source order
+  std::vector<std::string> transpileFunctions();
+
+ private:
+  void markStaticFunctions(Transpiler& transpiler);
+};
+
+// Runs every phase over source. Returns false with a message in error when
+// the program does not parse, declares a name twice in one scope, uses an
+// undefined name or does not type check.
+bool compileSource(std::string_view source, const ParseOptions& options, std::string& output, std::string& error,
+                   ThreadPool *pool = nullptr);
+
+#endif
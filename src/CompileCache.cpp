@@ -0,0 +1,283 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "CompileCache.h"
+
+
+// bump when the entry layout changes
+static const char kFormat[] = "tmplang-cache 1";
+
+namespace {
+
+struct Fnv {
+  uint64_t hash;
+
+  explicit Fnv(uint64_t basis = 14695981039346656037ull) : hash(basis) {}
+
+  void mix(const void *data, size_t size) {
+    auto *bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+      hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+  }
+};
+
+std::string hex(uint64_t value) {
+  char text[17];
+  snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+  return text;
+}
+
+// mkdir -p
+bool makeDirectories(const std::string& path) {
+  for (size_t i = 1; i <= path.size(); i++) {
+    if (i == path.size() || path[i] == '/') {
+      std::string prefix = path.substr(0, i);
+      if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool isHexName(const char *name, size_t length) {
+  if (strlen(name) != length) {
+    return false;
+  }
+  for (size_t i = 0; i < length; i++) {
+    if (!isxdigit(static_cast<unsigned char>(name[i]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+
+CompileCache::CompileCache(const std::string& _directory, uint64_t _maxBytes, std::string_view variant)
+  : directory(_directory), maxBytes(_maxBytes) {
+  // the binary's size and modification time stand in for its version
+  Fnv fnv;
+  fnv.mix(kFormat, sizeof(kFormat));
+  struct stat st;
+  if (stat("/proc/self/exe", &st) == 0) {
+    fnv.mix(&st.st_size, sizeof(st.st_size));
+    fnv.mix(&st.st_mtim, sizeof(st.st_mtim));
+  }
+  else {
+    fnv.mix(__DATE__ __TIME__, sizeof(__DATE__ __TIME__));
+  }
+  fnv.mix(variant.data(), variant.size());
+  compilerHash = fnv.hash;
+}
+
+CompileCache::~CompileCache() {
+  flushStats();
+  if (stored > 0) {
+    trim();
+  }
+}
+
+std::string CompileCache::defaultDirectory() {
+  if (const char *dir = getenv("TMPLANG_CACHE_DIR")) {
+    return dir;
+  }
+  if (const char *dir = getenv("XDG_CACHE_HOME")) {
+    return std::string(dir) + "/tmplang";
+  }
+  const char *home = getenv("HOME");
+  return std::string(home != nullptr ? home : ".") + "/.cache/tmplang";
+}
+
+CompileCache::Key CompileCache::keyOf(std::string_view source) const {
+  Fnv hash(compilerHash);
+  hash.mix(source.data(), source.size());
+  Fnv check;
+  check.mix(source.data(), source.size());
+  return Key{ hash.hash, check.hash, source.size() };
+}
+
+// entries are spread over 256 subdirectories by the first byte of the hash
+std::string CompileCache::entryPath(const Key& key) const {
+  std::string name = hex(key.hash);
+  return directory + "/" + name.substr(0, 2) + "/" + name.substr(2);
+}
+
+bool CompileCache::lookup(std::string_view source, CachedCompile& result) {
+  Key key = keyOf(source);
+  std::string path = entryPath(key);
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    misses++;
+    return false;
+  }
+  std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+  // header: format line, then "<length> <check>" and "<signature bytes> <output bytes>"
+  std::string expected = std::string(kFormat) + "\n" + std::to_string(key.length) + " " + hex(key.check) + "\n";
+  unsigned long long signatureBytes, outputBytes;
+  int headerEnd = 0;
+  if (data.compare(0, expected.size(), expected) != 0 ||
+      sscanf(data.c_str() + expected.size(), "%llu %llu\n%n", &signatureBytes, &outputBytes, &headerEnd) != 2 ||
+      headerEnd == 0 || data.size() != expected.size() + headerEnd + signatureBytes + outputBytes) {
+    misses++;
+    return false;
+  }
+  size_t offset = expected.size() + headerEnd;
+  result.signatures = data.substr(offset, signatureBytes);
+  result.output = data.substr(offset + signatureBytes, outputBytes);
+
+  // the modification time orders entries for eviction
+  utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+  hits++;
+  return true;
+}
+
+void CompileCache::store(std::string_view source, const CachedCompile& result) {
+  Key key = keyOf(source);
+  std::string path = entryPath(key);
+  std::string parent = path.substr(0, path.rfind('/'));
+  if (!makeDirectories(parent)) {
+    return;
+  }
+
+  std::string temp = parent + "/tmp." + std::to_string(getpid()) + "." + std::to_string(tempCounter++);
+  {
+    std::ofstream out(temp, std::ios::binary);
+    out << kFormat << "\n" << key.length << " " << hex(key.check) << "\n"
+        << result.signatures.size() << " " << result.output.size() << "\n"
+        << result.signatures << result.output;
+    if (!out.flush()) {
+      out.close();
+      unlink(temp.c_str());
+      return;
+    }
+  }
+  if (rename(temp.c_str(), path.c_str()) != 0) {
+    unlink(temp.c_str());
+    return;
+  }
+  stored++;
+}
+
+std::vector<CompileCache::Entry> CompileCache::listEntries() {
+  std::vector<Entry> entries;
+  DIR *top = opendir(directory.c_str());
+  if (top == nullptr) {
+    return entries;
+  }
+  while (dirent *sub = readdir(top)) {
+    if (!isHexName(sub->d_name, 2)) {
+      continue;
+    }
+    std::string subPath = directory + "/" + sub->d_name;
+    DIR *dir = opendir(subPath.c_str());
+    if (dir == nullptr) {
+      continue;
+    }
+    while (dirent *file = readdir(dir)) {
+      if (file->d_name[0] == '.') {
+        continue;
+      }
+      // left-over temporary files of crashed runs are counted and evicted like entries
+      Entry entry;
+      entry.path = subPath + "/" + file->d_name;
+      struct stat st;
+      if (stat(entry.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        continue;
+      }
+      entry.size = st.st_size;
+      entry.lastUse = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+      entries.push_back(std::move(entry));
+    }
+    closedir(dir);
+  }
+  closedir(top);
+  return entries;
+}
+
+void CompileCache::trim() {
+  std::vector<Entry> entries = listEntries();
+  uint64_t total = 0;
+  for (auto& entry : entries) {
+    total += entry.size;
+  }
+  if (total <= maxBytes) {
+    return;
+  }
+
+  // go a little below the limit so the next few stores don't trim again
+  uint64_t target = maxBytes / 10 * 9;
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+    return a.lastUse < b.lastUse;
+  });
+  for (auto& entry : entries) {
+    if (total <= target) {
+      break;
+    }
+    if (unlink(entry.path.c_str()) == 0) {
+      total -= entry.size;
+    }
+  }
+}
+
+// adds this run's counts to "<directory>/stats" under an exclusive lock
+void CompileCache::flushStats() {
+  uint64_t newHits = hits.exchange(0);
+  uint64_t newMisses = misses.exchange(0);
+  if (newHits == 0 && newMisses == 0) {
+    return;
+  }
+  if (!makeDirectories(directory)) {
+    return;
+  }
+  std::string path = directory + "/stats";
+  int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    return;
+  }
+  flock(fd, LOCK_EX);
+  char text[64] = {};
+  ssize_t n = pread(fd, text, sizeof(text) - 1, 0);
+  unsigned long long total[2] = { 0, 0 };
+  if (n > 0) {
+    sscanf(text, "%llu %llu", &total[0], &total[1]);
+  }
+  total[0] += newHits;
+  total[1] += newMisses;
+  int length = snprintf(text, sizeof(text), "%llu %llu\n", total[0], total[1]);
+  if (pwrite(fd, text, length, 0) == length) {
+    ftruncate(fd, length);
+  }
+  flock(fd, LOCK_UN);
+  close(fd);
+}
+
+CacheStats CompileCache::stats() {
+  flushStats();
+  CacheStats result;
+  std::ifstream in(directory + "/stats");
+  in >> result.hits >> result.misses;
+  for (auto& entry : listEntries()) {
+    result.entries++;
+    result.bytes += entry.size;
+  }
+  return result;
+}
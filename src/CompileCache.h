@@ -0,0 +1,82 @@
+#ifndef COMPILE_CACHE_H_
+#define COMPILE_CACHE_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+
+// result of compiling one source, as kept by the cache
+struct CachedCompile {
+  // inferred signature of each top-level function (CompilationContext::signatures)
+  std::string signatures;
+  std::string output;
+};
+
+struct CacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t entries = 0;
+  uint64_t bytes = 0;
+};
+
+// On-disk cache of compile results shared by every run on the machine.
+// An entry is found by a hash of the source text and of the compiler binary,
+// so rebuilding the compiler invalidates everything it cached. Entries are
+// written to a temporary file and renamed into place, so concurrent runs
+// never see a partial entry. Once the directory grows past its size limit
+// the least recently used entries are removed.
+// lookup and store may be called from several threads.
+class CompileCache {
+ public:
+  // variant names the options that change the output, which keep separate entries
+  CompileCache(const std::string& _directory, uint64_t _maxBytes, std::string_view variant = "");
+  // records the hits and misses of this run in the shared statistics
+  ~CompileCache();
+  CompileCache(const CompileCache&) = delete;
+  CompileCache& operator=(const CompileCache&) = delete;
+
+  // $TMPLANG_CACHE_DIR, else $XDG_CACHE_HOME/tmplang, else ~/.cache/tmplang
+  static std::string defaultDirectory();
+
+  bool lookup(std::string_view source, CachedCompile& result);
+  void store(std::string_view source, const CachedCompile& result);
+
+  // counts of every run so far, including this one
+  CacheStats stats();
+
+  // removes the oldest entries until the cache fits in its limit
+  void trim();
+
+  const std::string directory;
+  const uint64_t maxBytes;
+
+ private:
+  struct Key {
+    uint64_t hash;
+    // second hash and length of the source, checked on lookup against collisions
+    uint64_t check;
+    uint64_t length;
+  };
+
+  struct Entry {
+    std::string path;
+    uint64_t size;
+    int64_t lastUse;
+  };
+
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+  std::atomic<uint64_t> stored{0};
+  std::atomic<uint64_t> tempCounter{0};
+  uint64_t compilerHash;
+
+  Key keyOf(std::string_view source) const;
+  std::string entryPath(const Key& key) const;
+  void flushStats();
+  std::vector<Entry> listEntries();
+};
+
+#endif
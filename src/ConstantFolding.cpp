@@ -0,0 +1,301 @@
+#include "ConstantFolding.h"
+
+#include <vector>
+#include <cstdint>
+
+
+static int64_t wrapInt(int64_t value) {
+  return static_cast<int32_t>(static_cast<uint32_t>(value));
+}
+
+// literal kind holding a value of type; false for float or an open type
+static bool literalKind(Type *type, NodeKind& kind) {
+  auto *concrete = (type != nullptr) ? type->resolved()->as<ConcreteType>() : nullptr;
+  if (concrete == nullptr) {
+    return false;
+  }
+  switch (concrete->primitive) {
+    case PrimitiveKind::Int: kind = NodeKind::IntLiteral; return true;
+    case PrimitiveKind::Char: kind = NodeKind::CharLiteral; return true;
+    case PrimitiveKind::Bool: kind = NodeKind::BoolLiteral; return true;
+    default: return false;
+  }
+}
+
+void ConstantFolder::visit(NodeId node) {
+  for (auto func : ast.list(node)) {
+    assignments.clear();
+    constants.clear();
+    NodeId body = ast[func].operands[0];
+    currentScope = scopes[func];
+    countAssignments(body);
+    currentScope = scopes[func];
+    visitBlock(body);
+  }
+}
+
+void ConstantFolder::countAssignments(NodeId node) {
+  const Node& n = ast[node];
+  switch (n.kind) {
+    case NodeKind::Block: {
+      ScopeId saved = currentScope;
+      currentScope = scopes[node];
+      for (auto stmt : ast.list(node)) {
+        countAssignments(stmt);
+      }
+      currentScope = saved;
+      break;
+    }
+
+    case NodeKind::If: {
+      ScopeId saved = currentScope;
+      currentScope = scopes[node];
+      countAssignments(n.operands[1]);
+      if (n.operands[2] != NoNode) {
+        countAssignments(n.operands[2]);
+      }
+      currentScope = saved;
+      break;
+    }
+
+    case NodeKind::VarDecl:
+      if (n.operands[0] != NoNode) {
+        assignments[symbolKey(currentScope, n.name)]++;
+      }
+      break;
+
+    case NodeKind::Assign:
+      assignments[symbolKey(scopeTable.resolveScope(currentScope, n.name), n.name)]++;
+      break;
+
+    default:
+      break;
+  }
+}
+
+void ConstantFolder::visitBlock(NodeId node) {
+  ScopeId saved = currentScope;
+  currentScope = scopes[node];
+
+  // pruned ifs leave the list; it is rewritten in place, never longer
+  std::vector<NodeId> statements;
+  for (auto stmt : ast.list(node)) {
+    if (ast[stmt].kind == NodeKind::If) {
+      stmt = visitIf(stmt);
+    }
+    else {
+      visitStatement(stmt);
+    }
+    if (stmt != NoNode) {
+      statements.push_back(stmt);
+    }
+  }
+  Node& block = ast[node];
+  for (size_t i = 0; i < statements.size(); i++) {
+    ast.lists[block.listBegin + i] = statements[i];
+  }
+  block.listSize = statements.size();
+
+  currentScope = saved;
+}
+
+void ConstantFolder::visitStatement(NodeId node) {
+  Node& n = ast[node];
+  switch (n.kind) {
+    case NodeKind::Block:
+      visitBlock(node);
+      break;
+
+    case NodeKind::VarDecl:
+      if (n.operands[0] != NoNode && fold(n.operands[0])) {
+        uint64_t key = symbolKey(currentScope, n.name);
+        if (assignments[key] == 1) {
+          constants[key] = n.operands[0];
+        }
+      }
+      break;
+
+    case NodeKind::Assign:
+    case NodeKind::ExprStmt:
+      fold(n.operands[0]);
+      break;
+
+    case NodeKind::Return:
+      if (n.operands[0] != NoNode) {
+        fold(n.operands[0]);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+NodeId ConstantFolder::visitIf(NodeId node) {
+  ScopeId scope = scopes[node];
+  ScopeId saved = currentScope;
+  currentScope = scope;
+  bool constant = fold(ast[node].operands[0]);
+  currentScope = saved;
+
+  if (constant) {
+    // the branch taken moves up to where the if was, scope included
+    NodeId branch = ast[node].operands[ast[ast[node].operands[0]].value ? 1 : 2];
+    detachScope(scope, (branch == NoNode) ? NoScope : scopes[branch]);
+    prunedIfs++;
+    if (branch == NoNode) {
+      return NoNode;
+    }
+    if (ast[branch].kind == NodeKind::If) {
+      return visitIf(branch);
+    }
+    visitBlock(branch);
+    return branch;
+  }
+
+  currentScope = scope;
+  visitBlock(ast[node].operands[1]);
+  NodeId elseBranch = ast[node].operands[2];
+  if (elseBranch != NoNode) {
+    if (ast[elseBranch].kind == NodeKind::If) {
+      ast[node].operands[2] = visitIf(elseBranch);
+    }
+    else {
+      visitBlock(elseBranch);
+    }
+  }
+  currentScope = saved;
+  return node;
+}
+
+// Puts replacement where scope was among its parent's children, or only
+// drops scope when there is none. The variables of the dropped scopes are
+// no longer declared.
+void ConstantFolder::detachScope(ScopeId scope, ScopeId replacement) {
+  ScopeId parent = scopeTable[scope].parent;
+  auto& children = scopeTable[parent].children;
+  size_t kept = 0;
+  for (size_t i = 0; i < children.size(); i++) {
+    if (children[i] != scope) {
+      children[kept++] = children[i];
+    }
+    else if (replacement != NoScope) {
+      children[kept++] = replacement;
+    }
+  }
+  while (children.size() > kept) {
+    children.pop_back();
+  }
+  if (replacement != NoScope) {
+    scopeTable[replacement].parent = parent;
+  }
+}
+
+bool ConstantFolder::fold(NodeId node) {
+  Node& n = ast[node];
+  auto becomeLiteral = [&](NodeKind kind, int64_t value) {
+    n.kind = kind;
+    n.value = value;
+    n.operands[0] = n.operands[1] = n.operands[2] = NoNode;
+    n.listSize = 0;
+    foldedExpressions++;
+    return true;
+  };
+
+  switch (n.kind) {
+    case NodeKind::IntLiteral:
+    case NodeKind::CharLiteral:
+    case NodeKind::BoolLiteral:
+      return true;
+
+    case NodeKind::VarRef: {
+      ScopeId scope = scopeTable.resolveScope(currentScope, n.name);
+      if (scope == NoScope) {
+        return false;
+      }
+      auto it = constants.find(symbolKey(scope, n.name));
+      if (it == constants.end()) {
+        return false;
+      }
+      propagatedConstants++;
+      const Node& literal = ast[it->second];
+      return becomeLiteral(literal.kind, literal.value);
+    }
+
+    case NodeKind::Paren: {
+      if (!fold(n.operands[0])) {
+        return false;
+      }
+      const Node& inner = ast[n.operands[0]];
+      return becomeLiteral(inner.kind, inner.value);
+    }
+
+    case NodeKind::Call:
+      for (auto arg : ast.list(node)) {
+        fold(arg);
+      }
+      return false;
+
+    case NodeKind::Negate:
+    case NodeKind::Not: {
+      if (!fold(n.operands[0])) {
+        return false;
+      }
+      // an operator is typed like its operand, and the literal keeps that type
+      const Node& operand = ast[n.operands[0]];
+      NodeKind kind;
+      if (!literalKind((node < nodeTypes.size()) ? nodeTypes[node] : nullptr, kind) || operand.kind != kind) {
+        return false;
+      }
+      if (n.kind == NodeKind::Not) {
+        return becomeLiteral(kind, !operand.value);
+      }
+      if (kind == NodeKind::IntLiteral) {
+        return becomeLiteral(kind, wrapInt(-wrapInt(operand.value)));
+      }
+      // -true is -1 in C, which no bool literal holds
+      return (kind == NodeKind::CharLiteral && operand.value == 0) ? becomeLiteral(kind, 0) : false;
+    }
+
+    case NodeKind::Mul:
+    case NodeKind::Div:
+    case NodeKind::Add:
+    case NodeKind::Sub:
+    case NodeKind::Equal: {
+      bool left = fold(n.operands[0]);
+      bool right = fold(n.operands[1]);
+      if (!left || !right) {
+        return false;
+      }
+      const Node& lhs = ast[n.operands[0]];
+      const Node& rhs = ast[n.operands[1]];
+      bool isInt = (lhs.kind == NodeKind::IntLiteral);
+      int64_t a = isInt ? wrapInt(lhs.value) : lhs.value;
+      int64_t b = isInt ? wrapInt(rhs.value) : rhs.value;
+      if (n.kind == NodeKind::Equal) {
+        return becomeLiteral(NodeKind::BoolLiteral, a == b);
+      }
+      if (n.kind == NodeKind::Div && (b == 0 || (isInt && a == INT32_MIN && b == -1))) {
+        return false;
+      }
+
+      int64_t value;
+      switch (n.kind) {
+        case NodeKind::Mul: value = a * b; break;
+        case NodeKind::Div: value = a / b; break;
+        case NodeKind::Add: value = a + b; break;
+        default: value = a - b; break;
+      }
+      if (isInt) {
+        return becomeLiteral(NodeKind::IntLiteral, wrapInt(value));
+      }
+      if (lhs.kind == NodeKind::CharLiteral && a <= 127 && b <= 127 && value >= 0 && value <= 127) {
+        return becomeLiteral(NodeKind::CharLiteral, value);
+      }
+      return false;
+    }
+
+    default:
+      return false;
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef CONSTANT_FOLDING_H_
+#define CONSTANT_FOLDING_H_
+
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+#include "Type.h"
+#include "AST.h"
+#include "SymbolTable.h"
+
+
+// Rewrites an inferred Ast in place: operators over int, bool and char
+// literals become literals, locals assigned only by a literal declaration
+// are replaced by that literal where they are read after it, and an if
+// whose condition is constant is replaced by the branch it takes.
+//
+// Int literals fit in 32 bits, and int operators wrap at 32 bits. A division by zero or INT_MIN / -1 is
+// left to run, and char arithmetic is only folded within 0..127, where
+// C's int promotion gives the same value. ! and unary - only fold an
+// operand literal of the operator's own inferred type.
+class ConstantFolder {
+ public:
+  ConstantFolder(Ast& _ast, ScopeMap& _scopes, ScopeTable& _scopeTable, NodeTable<Type*>& _nodeTypes)
+    : ast(_ast), scopes(_scopes), scopeTable(_scopeTable), nodeTypes(_nodeTypes) {}
+
+  Ast& ast;
+  ScopeMap& scopes;
+  ScopeTable& scopeTable;
+  NodeTable<Type*>& nodeTypes;
+  ScopeId currentScope;
+
+  // expressions turned into literals, variable reads among them
+  size_t foldedExpressions = 0;
+  size_t propagatedConstants = 0;
+  size_t prunedIfs = 0;
+
+  void visit(NodeId node);
+
+ private:
+  // keyed by declaring scope and name
+  std::unordered_map<uint64_t, uint32_t> assignments;
+  std::unordered_map<uint64_t, NodeId> constants;
+
+  uint64_t symbolKey(ScopeId scope, SymbolId name) const { return (uint64_t(scope) << 32) | name; }
+
+  void countAssignments(NodeId node);
+  void visitBlock(NodeId node);
+  void visitStatement(NodeId node);
+  // the statement taking the place of an if: itself, a branch or NoNode
+  NodeId visitIf(NodeId node);
+  // true when node is a literal afterwards
+  bool fold(NodeId node);
+  void detachScope(ScopeId scope, ScopeId replacement);
+};
+
+#endif
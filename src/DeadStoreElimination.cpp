@@ -0,0 +1,270 @@
+#include "DeadStoreElimination.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+
+void DeadStoreEliminator::visit(NodeId node) {
+  for (auto func : ast.list(node)) {
+    collectSymbols(scopes[func]);
+    LiveSet live((bits.size() + 63) / 64, 0);
+    currentScope = scopes[func];
+    visitBlock(ast[func].operands[0], live);
+
+    currentScope = scopes[func];
+    markReferences(ast[func].operands[0]);
+    dropUnreferenced();
+  }
+}
+
+void DeadStoreEliminator::collectSymbols(ScopeId functionScope) {
+  bits.clear();
+  functionScopes.clear();
+  functionScopes.push_back(functionScope);
+  for (size_t i = 0; i < functionScopes.size(); i++) {
+    ScopeId scope = functionScopes[i];
+    for (auto& symbol : scopeTable[scope].symbols) {
+      uint32_t bit = bits.size();
+      bits[(uint64_t(scope) << 32) | symbol.name] = bit;
+    }
+    for (auto child : scopeTable[scope].children) {
+      functionScopes.push_back(child);
+    }
+  }
+  referenced.assign(bits.size(), false);
+}
+
+int64_t DeadStoreEliminator::bitOf(ScopeId scope, SymbolId name) const {
+  if (scope == NoScope) {
+    return -1;
+  }
+  auto it = bits.find((uint64_t(scope) << 32) | name);
+  return (it == bits.end()) ? -1 : int64_t(it->second);
+}
+
+void DeadStoreEliminator::addUses(NodeId node, LiveSet& live) {
+  const Node& n = ast[node];
+  switch (n.kind) {
+    case NodeKind::VarRef: {
+      int64_t bit = resolve(n.name);
+      if (bit >= 0) {
+        set(live, bit);
+      }
+      break;
+    }
+
+    case NodeKind::Call:
+      // the callee is any expression, and may read a local
+      addUses(n.operands[0], live);
+      for (auto arg : ast.list(node)) {
+        addUses(arg, live);
+      }
+      break;
+
+    default:
+      for (auto operand : n.operands) {
+        if (operand != NoNode) {
+          addUses(operand, live);
+        }
+      }
+      break;
+  }
+}
+
+bool DeadStoreEliminator::hasCall(NodeId node) const {
+  const Node& n = ast[node];
+  if (n.kind == NodeKind::Call) {
+    return true;
+  }
+  for (auto operand : n.operands) {
+    if (operand != NoNode && hasCall(operand)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// live holds what is read after the block on entry, and what is read from
+// its start on return
+void DeadStoreEliminator::visitBlock(NodeId node, LiveSet& live) {
+  ScopeId saved = currentScope;
+  currentScope = scopes[node];
+
+  NodeList list = ast.list(node);
+  std::vector<NodeId> statements(list.begin(), list.end());
+  std::vector<bool> keep(statements.size());
+  for (size_t i = statements.size(); i-- > 0;) {
+    keep[i] = visitStatement(statements[i], live);
+  }
+
+  Node& block = ast[node];
+  size_t kept = 0;
+  for (size_t i = 0; i < statements.size(); i++) {
+    if (keep[i]) {
+      ast.lists[block.listBegin + kept++] = statements[i];
+    }
+  }
+  block.listSize = kept;
+
+  currentScope = saved;
+}
+
+bool DeadStoreEliminator::visitStatement(NodeId node, LiveSet& live) {
+  Node& n = ast[node];
+  switch (n.kind) {
+    case NodeKind::Block:
+      visitBlock(node, live);
+      return true;
+
+    case NodeKind::If: {
+      ScopeId saved = currentScope;
+      currentScope = scopes[node];
+      LiveSet elseLive = live;
+      if (n.operands[2] != NoNode) {
+        visitStatement(n.operands[2], elseLive);
+      }
+      visitBlock(n.operands[1], live);
+      for (size_t i = 0; i < live.size(); i++) {
+        live[i] |= elseLive[i];
+      }
+      currentScope = saved;
+
+      // nothing left in either branch
+      NodeId elseBranch = n.operands[2];
+      bool empty = ast[n.operands[1]].listSize == 0 &&
+        (elseBranch == NoNode || (ast[elseBranch].kind == NodeKind::Block && ast[elseBranch].listSize == 0));
+      if (empty && !hasCall(n.operands[0])) {
+        return false;
+      }
+      currentScope = scopes[node];
+      addUses(n.operands[0], live);
+      currentScope = saved;
+      return true;
+    }
+
+    case NodeKind::Return:
+      // nothing after a return is reached
+      std::fill(live.begin(), live.end(), 0);
+      if (n.operands[0] != NoNode) {
+        addUses(n.operands[0], live);
+      }
+      return true;
+
+    case NodeKind::ExprStmt:
+      addUses(n.operands[0], live);
+      return true;
+
+    case NodeKind::VarDecl:
+    case NodeKind::Assign: {
+      int64_t bit = (n.kind == NodeKind::VarDecl) ? bitOf(currentScope, n.name) : resolve(n.name);
+      NodeId value = n.operands[0];
+      if (bit < 0 || test(live, bit)) {
+        if (bit >= 0) {
+          reset(live, bit);
+        }
+        if (value != NoNode) {
+          addUses(value, live);
+        }
+        return true;
+      }
+
+      removedStores++;
+      if (value != NoNode && hasCall(value)) {
+        n.kind = NodeKind::ExprStmt;
+        n.name = NoSymbol;
+        addUses(value, live);
+        return true;
+      }
+      return false;
+    }
+
+    default:
+      return true;
+  }
+}
+
+void DeadStoreEliminator::markReferences(NodeId node) {
+  const Node& n = ast[node];
+  switch (n.kind) {
+    case NodeKind::Block:
+    case NodeKind::If: {
+      ScopeId saved = currentScope;
+      currentScope = scopes[node];
+      if (n.kind == NodeKind::Block) {
+        for (auto stmt : ast.list(node)) {
+          markReferences(stmt);
+        }
+      }
+      else {
+        for (auto operand : n.operands) {
+          if (operand != NoNode) {
+            markReferences(operand);
+          }
+        }
+      }
+      currentScope = saved;
+      break;
+    }
+
+    case NodeKind::VarDecl: {
+      int64_t bit = bitOf(currentScope, n.name);
+      if (bit >= 0) {
+        referenced[bit] = true;
+      }
+      if (n.operands[0] != NoNode) {
+        markReferences(n.operands[0]);
+      }
+      break;
+    }
+
+    case NodeKind::Assign:
+    case NodeKind::VarRef: {
+      int64_t bit = resolve(n.name);
+      if (bit >= 0) {
+        referenced[bit] = true;
+      }
+      if (n.operands[0] != NoNode) {
+        markReferences(n.operands[0]);
+      }
+      break;
+    }
+
+    case NodeKind::Call:
+      markReferences(n.operands[0]);
+      for (auto arg : ast.list(node)) {
+        markReferences(arg);
+      }
+      break;
+
+    default:
+      for (auto operand : n.operands) {
+        if (operand != NoNode) {
+          markReferences(operand);
+        }
+      }
+      break;
+  }
+}
+
+// parameters stay, as they are part of the signature
+void DeadStoreEliminator::dropUnreferenced() {
+  for (auto scope : functionScopes) {
+    if (scopeTable[scope].kind != BLOCK) {
+      continue;
+    }
+    auto& symbols = scopeTable[scope].symbols;
+    size_t kept = 0;
+    for (size_t i = 0; i < symbols.size(); i++) {
+      if (referenced[bitOf(scope, symbols[i].name)]) {
+        symbols[kept++] = symbols[i];
+      }
+      else {
+        removedVariables++;
+      }
+    }
+    while (symbols.size() > kept) {
+      symbols.pop_back();
+    }
+  }
+}
@@ -0,0 +1,64 @@
+#ifndef DEAD_STORE_ELIMINATION_H_
+#define DEAD_STORE_ELIMINATION_H_
+
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+#include "AST.h"
+#include "SymbolTable.h"
+
+
+// Removes stores no later statement reads, found by backward liveness
+// over each function body, then the locals nothing refers to any more, so
+// they are neither hoisted into the C nor given VM registers. The language
+// has no loops, so one backward pass over the statements is exact.
+//
+// A dead store whose value calls a function keeps the call as an
+// expression statement, since the call may not return. The Transpiler
+// casts such a statement to void unless it is the call alone.
+class DeadStoreEliminator {
+ public:
+  DeadStoreEliminator(Ast& _ast, ScopeMap& _scopes, ScopeTable& _scopeTable)
+    : ast(_ast), scopes(_scopes), scopeTable(_scopeTable) {}
+
+  Ast& ast;
+  ScopeMap& scopes;
+  ScopeTable& scopeTable;
+  ScopeId currentScope;
+
+  size_t removedStores = 0;
+  size_t removedVariables = 0;
+
+  void visit(NodeId node);
+
+ private:
+  // one bit per parameter and local of the current function
+  using LiveSet = std::vector<uint64_t>;
+
+  // bit of each symbol, keyed by declaring scope and name
+  std::unordered_map<uint64_t, uint32_t> bits;
+  std::vector<ScopeId> functionScopes;
+  std::vector<bool> referenced;
+
+  static bool test(const LiveSet& live, uint32_t bit) { return (live[bit / 64] >> (bit % 64)) & 1; }
+  static void set(LiveSet& live, uint32_t bit) { live[bit / 64] |= uint64_t(1) << (bit % 64); }
+  static void reset(LiveSet& live, uint32_t bit) { live[bit / 64] &= ~(uint64_t(1) << (bit % 64)); }
+
+  void collectSymbols(ScopeId functionScope);
+  // bit of name declared in scope, or as seen from the current scope; -1 for
+  // anything but a parameter or local
+  int64_t bitOf(ScopeId scope, SymbolId name) const;
+  int64_t resolve(SymbolId name) const { return bitOf(scopeTable.resolveScope(currentScope, name), name); }
+
+  void addUses(NodeId node, LiveSet& live);
+  bool hasCall(NodeId node) const;
+  void visitBlock(NodeId node, LiveSet& live);
+  // false when the statement is to be removed
+  bool visitStatement(NodeId node, LiveSet& live);
+  void markReferences(NodeId node);
+  void dropUnreferenced();
+};
+
+#endif
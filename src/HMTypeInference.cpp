@@ -1,118 +1,311 @@
 #include <vector>
 #include <unordered_map>
 #include <optional>
+#include <utility>
+#include <algorithm>
+#include <atomic>
+#include <functional>
 
 #include "Type.h"
 #include "HMTypeInference.h"
+#include "CallGraph.h"
+#include "ThreadPool.h"
 
 
-std::optional<std::unordered_map<int, Type*>> unifyVariable(TypeVar *typeVar, Type *type, std::unordered_map<int, Type*> subst);
+// Unification works in place on the union-find state stored in each TypeVar,
+// so binding a variable costs nearly O(1) instead of copying the substitution.
 
-std::optional<std::unordered_map<int, Type*>> unify(Type *x, Type *y, std::optional<std::unordered_map<int, Type*>> subst) {
-  if (!subst.has_value()) {
-    return std::nullopt;
+static TypeVar* findRoot(TypeVar *typeVar) {
+  TypeVar *root = typeVar;
+  while (root->parent != nullptr) {
+    root = root->parent;
   }
-  if (x->equal(y)) {
-    return subst;
-  }
-  auto *varX = dynamic_cast<TypeVar*>(x);
-  if (varX != nullptr) {
-    return unifyVariable(varX, y, subst.value());
+  // path compression
+  while (typeVar != root) {
+    TypeVar *next = typeVar->parent;
+    if (next != root) {
+      typeVar->parent = root;
+    }
+    typeVar = next;
   }
-  auto *varY = dynamic_cast<TypeVar*>(y);
-  if (varY != nullptr) {
-    return unifyVariable(varY, x, subst.value());
+  return root;
+}
+
+Type* Unifier::find(Type *type) {
+  if (type->kind != TypeKind::Var) {
+    return type;
   }
-  auto *funcX = dynamic_cast<FunctionType*>(x);
-  auto *funcY = dynamic_cast<FunctionType*>(y);
-  if (funcX != nullptr && funcY != nullptr) {
-    if (funcX->from.size() != funcY->from.size()) {
-      return std::nullopt;
+  TypeVar *root = findRoot(static_cast<TypeVar*>(type));
+  return (root->instance != nullptr) ? root->instance : root;
+}
+
+bool Unifier::occurs(TypeVar *typeVar, Type *type) {
+  std::vector<Type*> stack{ type };
+  while (!stack.empty()) {
+    Type *t = find(stack.back());
+    stack.pop_back();
+    if (t == typeVar) {
+      return true;
     }
-    subst = unify(funcX->to, funcY->to, subst);
-    for (int i = 0; i < funcX->from.size(); i++) {
-      subst = unify(funcX->from[i], funcY->from[i], subst);
+    auto *fType = t->as<FunctionType>();
+    if (fType != nullptr) {
+      stack.push_back(fType->to);
+      for (auto *arg : fType->from) {
+        stack.push_back(arg);
+      }
     }
-    return subst;
   }
-  return std::nullopt;
+  return false;
 }
 
-bool occursCheck(TypeVar *typeVar, Type *type, std::unordered_map<int, Type*>& subst) {
-  if (type->equal((Type*)typeVar)) {
+bool Unifier::bindVariable(TypeVar *typeVar, Type *type) {
+  auto *other = type->as<TypeVar>();
+  if (other != nullptr) {
+    // both are representatives without an instance: union by rank
+    if (typeVar->rank < other->rank) {
+      std::swap(typeVar, other);
+    }
+    other->parent = typeVar;
+    if (typeVar->rank == other->rank) {
+      typeVar->rank++;
+    }
+    bound.push_back(other);
     return true;
   }
-  TypeVar *utypeVar = dynamic_cast<TypeVar*>(type);
-  if (utypeVar != nullptr && subst.find(utypeVar->id) != subst.end()) {
-    return occursCheck(typeVar, subst[utypeVar->id], subst);
+  if (occurs(typeVar, type)) {
+    return false;
   }
-  FunctionType *fType = dynamic_cast<FunctionType*>(type);
-  if (fType != nullptr) {
-    if (occursCheck(typeVar, fType->to, subst)) {
-      return true;
+  typeVar->instance = type;
+  bound.push_back(typeVar);
+  return true;
+}
+
+bool Unifier::unify(Type *x, Type *y) {
+  std::vector<std::pair<Type*, Type*>> pending{ { x, y } };
+  while (!pending.empty()) {
+    Type *a = find(pending.back().first);
+    Type *b = find(pending.back().second);
+    pending.pop_back();
+
+    if (a->equal(b)) {
+      continue;
     }
-    for (auto *arg : fType->from) {
-      if (occursCheck(typeVar, arg, subst)) {
-        return true;
-      }
+    if (a->kind == TypeKind::Var) {
+      if (!bindVariable(static_cast<TypeVar*>(a), b)) return false;
+      continue;
+    }
+    if (b->kind == TypeKind::Var) {
+      if (!bindVariable(static_cast<TypeVar*>(b), a)) return false;
+      continue;
+    }
+    // distinct concrete types never unify, since primitives are singletons
+    if (a->kind != TypeKind::Function || b->kind != TypeKind::Function) {
+      return false;
+    }
+    auto *funcA = static_cast<FunctionType*>(a);
+    auto *funcB = static_cast<FunctionType*>(b);
+    if (funcA->from.size() != funcB->from.size()) {
+      return false;
+    }
+    pending.emplace_back(funcA->to, funcB->to);
+    for (int i = 0; i < funcA->from.size(); i++) {
+      pending.emplace_back(funcA->from[i], funcB->from[i]);
     }
   }
-  return false;
+  return true;
 }
 
-std::optional<std::unordered_map<int, Type*>> unifyVariable(TypeVar *typeVar, Type *type, std::unordered_map<int, Type*> subst) {
-  if (subst.find(typeVar->id) != subst.end()) {
-    return unify(subst[typeVar->id], type, subst);
+Type* Unifier::ground(TypeContext& types, Type *type) {
+  type = find(type);
+  auto *fType = type->as<FunctionType>();
+  if (fType == nullptr) {
+    return (type->kind == TypeKind::Var) ? nullptr : type;
   }
-  TypeVar *utypeVar = dynamic_cast<TypeVar*>(type);
-  if (utypeVar != nullptr && subst.find(utypeVar->id) != subst.end()) {
-    return unify(typeVar, subst[utypeVar->id], subst);
-  }
-  if (occursCheck(typeVar, type, subst)) {
-    return std::nullopt;
+  std::vector<Type*> from;
+  bool changed = false;
+  for (auto *arg : fType->from) {
+    from.push_back(ground(types, arg));
+    if (from.back() == nullptr) return nullptr;
+    changed |= (from.back() != arg);
   }
+  Type *to = ground(types, fType->to);
+  if (to == nullptr) return nullptr;
+  changed |= (to != fType->to);
+  return changed ? types.getFunctionType(from, to) : fType;
+}
 
-  std::unordered_map<int, Type*> newSubst = subst;
-  newSubst.emplace(typeVar->id, type);
-  return newSubst;
+std::unordered_map<int, Type*> Unifier::substitution() {
+  std::unordered_map<int, Type*> subst;
+  subst.reserve(bound.size());
+  for (auto *typeVar : bound) {
+    subst[typeVar->id] = find(typeVar);
+  }
+  return subst;
 }
 
 std::optional<std::unordered_map<int, Type*>> unifyAllEquations(std::vector<TypeEquation>& equations) {
-  std::optional<std::unordered_map<int, Type*>> subst = std::unordered_map<int, Type*>{};
+  Unifier unifier;
   for (auto& eq : equations) {
-    subst = unify(eq.left, eq.right, subst);
-    if (subst == std::nullopt) break;
+    if (!unifier.unify(eq.left, eq.right)) {
+      return std::nullopt;
+    }
   }
-  return subst;
+  return unifier.substitution();
 }
 
-Type* applyUnifier(Type *type, std::unordered_map<int, Type*> subst) {
-  if (subst.empty()) {
-    return type;
+Type* Unifier::resolve(TypeContext& types, Type *type) {
+  switch (type->kind) {
+    case TypeKind::Concrete:
+      return type;
+    case TypeKind::Var: {
+      auto *typeVar = static_cast<TypeVar*>(type);
+      if (typeVar->resolution == nullptr) {
+        Type *representative = find(typeVar);
+        // an unconstrained class resolves to its root var
+        typeVar->resolution = (representative->kind == TypeKind::Var) ? representative : resolve(types, representative);
+      }
+      return typeVar->resolution;
+    }
+    case TypeKind::Function: {
+      auto *fType = static_cast<FunctionType*>(type);
+      if (fType->resolution == nullptr) {
+        std::vector<Type*> from;
+        bool changed = false;
+        for (auto *arg : fType->from) {
+          from.push_back(resolve(types, arg));
+          changed |= (from.back() != arg);
+        }
+        Type *to = resolve(types, fType->to);
+        changed |= (to != fType->to);
+        fType->resolution = changed ? types.getFunctionType(from, to) : fType;
+        // a resolved type is its own resolution
+        fType->resolution->as<FunctionType>()->resolution = fType->resolution;
+      }
+      return fType->resolution;
+    }
   }
-  ConcreteType intType{ "int" };
-  ConcreteType boolType{ "bool" };
-  ConcreteType charType{ "char" };
-  if (type->equal(&intType) || type->equal(&boolType) || type->equal(&charType)) {
-    return type;
+  return type;
+}
+
+void Unifier::resolveAll(TypeContext& types) {
+  for (auto *typeVar : types.allTypeVars()) {
+    resolve(types, typeVar);
+  }
+  for (auto *fType : types.allFunctionTypes()) {
+    resolve(types, fType);
+  }
+}
+
+// A component only ever binds its own type vars: the signature of a
+// finished callee is used in its ground form, and equations against a
+// callee signature that still has free vars (which the caller may pin down)
+// are deferred to one serial pass at the end.
+bool inferTypes(TypeContext& types, std::vector<FunctionConstraints>& functions, ThreadPool *pool) {
+  std::vector<std::vector<uint32_t>> edges(functions.size());
+  for (size_t f = 0; f < functions.size(); f++) {
+    for (auto callee : functions[f].callees) {
+      if (callee != NoFunction) {
+        edges[f].push_back(callee);
+      }
+    }
   }
-  auto *typeVar = dynamic_cast<TypeVar*>(type);
-  if (typeVar != nullptr) {
-    if (subst.find(typeVar->id) != subst.end()) {
-      return applyUnifier(subst[typeVar->id], subst);
+  CallGraph graph(std::move(edges));
+  size_t componentCount = graph.components.size();
+
+  // signatures of finished functions, nullptr while a free var is left in them
+  std::vector<Type*> groundSignatures(functions.size(), nullptr);
+  std::vector<std::vector<TypeEquation>> deferred(componentCount);
+  std::atomic<bool> failed{ false };
+
+  auto inferComponent = [&](uint32_t component) {
+    Unifier unifier;
+    for (auto f : graph.components[component]) {
+      auto& function = functions[f];
+      for (size_t i = 0; i < function.equations.size() && !failed; i++) {
+        TypeEquation eq = function.equations[i];
+        uint32_t callee = function.callees[i];
+        if (callee != NoFunction && graph.componentOf[callee] != component) {
+          if (groundSignatures[callee] == nullptr) {
+            deferred[component].push_back(eq);
+            continue;
+          }
+          eq.right = groundSignatures[callee];
+        }
+        if (!unifier.unify(eq.left, eq.right)) {
+          failed = true;
+        }
+      }
     }
-    else {
-      return type;
+    for (auto f : graph.components[component]) {
+      if (functions[f].signature != nullptr) {
+        groundSignatures[f] = unifier.ground(types, functions[f].signature);
+        functions[f].closed = (groundSignatures[f] != nullptr);
+      }
+    }
+  };
+
+  if (pool == nullptr || componentCount < 2) {
+    // components are already in dependency order
+    for (uint32_t c = 0; c < componentCount && !failed; c++) {
+      inferComponent(c);
+    }
+  }
+  else {
+    // number of distinct callee components not finished yet, and the reverse edges
+    std::vector<std::atomic<uint32_t>> waiting(componentCount);
+    std::vector<std::vector<uint32_t>> callers(componentCount);
+    for (uint32_t c = 0; c < componentCount; c++) {
+      std::vector<uint32_t> dependencies;
+      for (auto f : graph.components[c]) {
+        for (auto callee : graph.callees[f]) {
+          if (graph.componentOf[callee] != c) {
+            dependencies.push_back(graph.componentOf[callee]);
+          }
+        }
+      }
+      std::sort(dependencies.begin(), dependencies.end());
+      dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+      waiting[c] = dependencies.size();
+      for (auto d : dependencies) {
+        callers[d].push_back(c);
+      }
+    }
+
+    TaskGroup group;
+    std::function<void(uint32_t)> run = [&](uint32_t component) {
+      if (!failed) {
+        inferComponent(component);
+      }
+      for (auto caller : callers[component]) {
+        if (--waiting[caller] == 0) {
+          pool->submit([&run, caller] { run(caller); }, &group);
+        }
+      }
+    };
+    // collected first: once the first task runs, waiting counts start to drop
+    std::vector<uint32_t> ready;
+    for (uint32_t c = 0; c < componentCount; c++) {
+      if (waiting[c] == 0) {
+        ready.push_back(c);
+      }
     }
+    for (auto c : ready) {
+      pool->submit([&run, c] { run(c); }, &group);
+    }
+    pool->wait(group);
+  }
+  if (failed) {
+    return false;
   }
-  auto *fType = dynamic_cast<FunctionType*>(type);
-  if (fType != nullptr) {
-    auto *newFunctionType = addFunctionType();
-    for (auto *arg : fType->from) {
-      newFunctionType->from.push_back(applyUnifier(arg, subst));
+
+  Unifier unifier;
+  for (auto& equations : deferred) {
+    for (auto& eq : equations) {
+      if (!unifier.unify(eq.left, eq.right)) {
+        return false;
+      }
     }
-    newFunctionType->to = applyUnifier(fType->to, subst);
-    return newFunctionType;
   }
-  return nullptr;
+  unifier.resolveAll(types);
+  return true;
 }
@@ -4,16 +4,68 @@
 #include <vector>
 #include <unordered_map>
 #include <optional>
+#include <cstdint>
 
 #include "Type.h"
 
+class ThreadPool;
+
 
 struct TypeEquation {
   Type *left, *right;
 };
 
+// index of a top-level function in its file
+constexpr uint32_t NoFunction = UINT32_MAX;
+
+// Equations generated from the body of one top-level function. An equation
+// whose right side is the signature of another function records that
+// function in callees, so that functions can be inferred separately.
+struct FunctionConstraints {
+  Type *signature = nullptr;
+  std::vector<TypeEquation> equations;
+  // parallel to equations, NoFunction for most of them
+  std::vector<uint32_t> callees;
+  // set by inferTypes when the function's own call graph component fixed
+  // its signature, i.e. no caller can change its types
+  bool closed = false;
+};
+
+// Solves equations in place with union-find (path compression + union by rank)
+// over the TypeVar nodes themselves. Unifiers working on disjoint sets of
+// type vars may run concurrently.
+class Unifier {
+ public:
+  bool unify(Type *x, Type *y);
+
+  // representative of a type: the bound instance if any, otherwise the root var
+  Type* find(Type *type);
+
+  // type with every var substituted, or nullptr if a free var is left in it
+  Type* ground(TypeContext& types, Type *type);
+
+  // exports bindings as a var id -> type map
+  std::unordered_map<int, Type*> substitution();
+
+  // Resolution pass, run once after unification: writes the final type into
+  // every type var and function type of the context, after which
+  // Type::resolved() is an allocation-free O(1) lookup.
+  void resolveAll(TypeContext& types);
+
+ private:
+  std::vector<TypeVar*> bound;
+
+  bool bindVariable(TypeVar *typeVar, Type *type);
+  bool occurs(TypeVar *typeVar, Type *type);
+  Type* resolve(TypeContext& types, Type *type);
+};
+
 std::optional<std::unordered_map<int, Type*>> unifyAllEquations(std::vector<TypeEquation>& equations);
 
-Type* applyUnifier(Type *type, std::unordered_map<int, Type*> subst);
+// Unifies the equations of every function and resolves every type of the
+// context; false on a type error. Functions are solved one call graph
+// component at a time, callees first, and components that do not depend on
+// each other run concurrently on pool when one is given.
+bool inferTypes(TypeContext& types, std::vector<FunctionConstraints>& functions, ThreadPool *pool = nullptr);
 
 #endif
@@ -0,0 +1,314 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <iterator>
+
+#include "Type.h"
+#include "Interner.h"
+#include "Lexer.h"
+#include "CallGraph.h"
+#include "Compilation.h"
+#include "Incremental.h"
+
+
+// Splits source into top-level functions with the fast lexer alone. False
+// when it cannot lex the source or finds anything but functions at the top
+// level; such sources go through the full pipeline for its diagnostics.
+bool IncrementalCompiler::split(std::string_view source, std::vector<FunctionSpan>& spans) {
+  std::vector<LexToken> tokens;
+  if (!lexSource(source, names, tokens)) {
+    return false;
+  }
+
+  size_t i = 0;
+  while (tokens[i].kind != TokenKind::Eof) {
+    if (tokens[i].kind != TokenKind::Fn || tokens[i + 1].kind != TokenKind::Identifier) {
+      return false;
+    }
+    FunctionSpan span;
+    span.name = tokens[i + 1].symbol;
+    span.begin = tokens[i].offset;
+
+    // FNV-1a over the kinds and text of the tokens, so layout changes keep the hash
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](unsigned char byte) {
+      hash = (hash ^ byte) * 1099511628211ull;
+    };
+    int depth = 0;
+    bool closed = false;
+    for (; tokens[i].kind != TokenKind::Eof && !closed; i++) {
+      const LexToken& token = tokens[i];
+      mix(static_cast<unsigned char>(token.kind));
+      for (auto c : source.substr(token.offset, token.length)) {
+        mix(c);
+      }
+      if (token.kind == TokenKind::Identifier) {
+        span.identifiers.push_back(token.symbol);
+      }
+      else if (token.kind == TokenKind::LBrace) {
+        depth++;
+      }
+      else if (token.kind == TokenKind::RBrace && --depth == 0) {
+        closed = true;
+        span.end = token.offset + token.length;
+      }
+    }
+    if (!closed) {
+      return false;
+    }
+    span.hash = hash;
+    std::sort(span.identifiers.begin(), span.identifiers.end());
+    span.identifiers.erase(std::unique(span.identifiers.begin(), span.identifiers.end()), span.identifiers.end());
+    spans.push_back(std::move(span));
+  }
+  return true;
+}
+
+// Compiles the dirty functions alone. Clean functions are blanked out of
+// the text, which keeps every line and column of the dirty ones, and are
+// declared by their cached signatures instead.
+bool IncrementalCompiler::compileDirty(std::string_view source, const std::vector<FunctionSpan>& spans,
+                                       const std::vector<bool>& dirty,
+                                       std::unordered_map<SymbolId, CachedFunction>& results, std::string& error) {
+  std::string text(source);
+  CompilationContext context;
+  std::vector<const FunctionSpan*> compiled;
+  std::unordered_set<SymbolId> referenced;
+  for (size_t i = 0; i < spans.size(); i++) {
+    if (dirty[i]) {
+      compiled.push_back(&spans[i]);
+      referenced.insert(spans[i].identifiers.begin(), spans[i].identifiers.end());
+    }
+  }
+  for (size_t i = 0; i < spans.size(); i++) {
+    if (dirty[i]) {
+      continue;
+    }
+    for (uint32_t offset = spans[i].begin; offset < spans[i].end; offset++) {
+      if (text[offset] != '\n') {
+        text[offset] = ' ';
+      }
+    }
+    // only what the dirty functions can see, since root scope lookups are linear
+    const CachedFunction& cached = cache[spans[i].name];
+    if (cached.closed && referenced.count(spans[i].name) != 0) {
+      context.externals.push_back(ExternalFunction{ names.name(spans[i].name), cached.params, cached.result });
+    }
+  }
+
+  if (!context.parse(text, options)) {
+    error = "Syntax errors...";
+    return false;
+  }
+  if (!context.analyze(error)) {
+    return false;
+  }
+  if (!context.infer()) {
+    error = "Type inference failed...";
+    return false;
+  }
+  context.optimize();
+  std::vector<std::string> code = context.transpileFunctions();
+  if (code.size() != compiled.size()) {
+    error = "can't match the parsed functions to the source!!!";
+    return false;
+  }
+
+  for (size_t k = 0; k < compiled.size(); k++) {
+    CachedFunction entry;
+    entry.hash = compiled[k]->hash;
+    entry.closed = context.functions[k].closed;
+    entry.inlined = context.inlinedFunctions[k];
+    auto *signature = context.functions[k].signature->resolved()->as<FunctionType>();
+    for (auto *param : signature->from) {
+      entry.params.push_back(param->as<ConcreteType>()->primitive);
+      entry.signature += param->as<ConcreteType>()->name();
+      entry.signature += ",";
+    }
+    auto *result = signature->to->as<ConcreteType>();
+    if (result != nullptr) {
+      entry.result = result->primitive;
+    }
+    entry.signature += "->";
+    entry.signature += (result != nullptr) ? result->name() : "?";
+    entry.code = std::move(code[k]);
+    results[compiled[k]->name] = std::move(entry);
+  }
+  return true;
+}
+
+bool IncrementalCompiler::compile(std::string_view source, std::string& output, std::string& error) {
+  std::vector<FunctionSpan> spans;
+  std::unordered_map<SymbolId, uint32_t> indexOf;
+  // an empty source is a syntax error, left to the full pipeline
+  bool splitOk = split(source, spans) && !spans.empty();
+  for (uint32_t i = 0; splitOk && i < spans.size(); i++) {
+    // a name defined twice is reported by the full pipeline
+    splitOk = indexOf.emplace(spans[i].name, i).second;
+  }
+  if (!splitOk) {
+    // the cache stays for the next source unless this one compiles
+    if (!compileSource(source, options, output, error)) {
+      return false;
+    }
+    cache.clear();
+    recompiled = spans.size();
+    return true;
+  }
+
+  std::vector<bool> dirty(spans.size());
+  // the emitted code may differ from the cached one; the other dirty
+  // functions are only compiled to be inlined
+  std::vector<bool> changed(spans.size());
+  // names that mean something else than at the last compile
+  std::unordered_set<SymbolId> changedNames;
+  for (size_t i = 0; i < spans.size(); i++) {
+    auto it = cache.find(spans[i].name);
+    dirty[i] = changed[i] = (it == cache.end() || it->second.hash != spans[i].hash);
+    if (it == cache.end()) {
+      changedNames.insert(spans[i].name);
+    }
+  }
+  for (auto& entry : cache) {
+    if (indexOf.count(entry.first) == 0) {
+      changedNames.insert(entry.first);
+    }
+  }
+
+  // who may call whom, judged by identifiers only
+  std::vector<std::vector<uint32_t>> references(spans.size());
+  for (size_t i = 0; i < spans.size(); i++) {
+    for (auto identifier : spans[i].identifiers) {
+      auto it = indexOf.find(identifier);
+      if (it != indexOf.end()) {
+        references[i].push_back(it->second);
+      }
+    }
+  }
+  CallGraph graph(references);
+
+  // a cycle a changed function was part of may be gone
+  std::unordered_set<SymbolId> brokenComponents;
+  for (auto& entry : cache) {
+    auto it = indexOf.find(entry.first);
+    if (it == indexOf.end() || changed[it->second]) {
+      brokenComponents.insert(entry.second.component);
+    }
+  }
+  for (size_t i = 0; i < spans.size(); i++) {
+    auto it = cache.find(spans[i].name);
+    if (it != cache.end() && brokenComponents.count(it->second.component) != 0) {
+      dirty[i] = changed[i] = true;
+    }
+  }
+
+  std::unordered_map<SymbolId, CachedFunction> results;
+  while (true) {
+    for (size_t i = 0; i < spans.size(); i++) {
+      for (auto identifier : spans[i].identifiers) {
+        if (changedNames.count(identifier) != 0) {
+          dirty[i] = changed[i] = true;
+          break;
+        }
+      }
+    }
+
+    bool grew = true;
+    while (grew) {
+      grew = false;
+      for (size_t i = 0; i < spans.size(); i++) {
+        if (!dirty[i]) {
+          continue;
+        }
+        // mutually recursive functions are only inferred together
+        for (auto member : graph.components[graph.componentOf[i]]) {
+          grew |= !dirty[member] || (changed[i] && !changed[member]);
+          dirty[member] = true;
+          changed[member] = changed[member] || changed[i];
+        }
+        // a callee left open by its own body is typed by all of its callers,
+        // and an inlined one has to be there to be copied
+        for (auto callee : references[i]) {
+          auto it = cache.find(spans[callee].name);
+          if (!dirty[callee] && it != cache.end() && (!it->second.closed || it->second.inlined)) {
+            dirty[callee] = true;
+            grew = true;
+          }
+        }
+      }
+      // a changed function changes the callers it was copied into
+      for (size_t i = 0; i < spans.size(); i++) {
+        for (auto callee : references[i]) {
+          auto it = cache.find(spans[callee].name);
+          if (!changed[i] && changed[callee] && it != cache.end() && it->second.inlined && callee != i) {
+            dirty[i] = changed[i] = true;
+            grew = true;
+          }
+        }
+      }
+      for (size_t i = 0; i < spans.size(); i++) {
+        for (auto callee : references[i]) {
+          auto it = cache.find(spans[callee].name);
+          bool open = (it == cache.end() || !it->second.closed);
+          if (!dirty[i] && dirty[callee] && open && callee != i) {
+            dirty[i] = true;
+            grew = true;
+          }
+        }
+      }
+    }
+
+    results.clear();
+    // nothing to parse when only layout changed or unused functions went
+    // away; the output is made of the cached code alone
+    if (std::find(dirty.begin(), dirty.end(), true) == dirty.end()) {
+      break;
+    }
+    if (!compileDirty(source, spans, dirty, results, error)) {
+      return false;
+    }
+
+    // a new signature sends its users around once more
+    changedNames.clear();
+    for (auto& entry : results) {
+      auto it = cache.find(entry.first);
+      if (it == cache.end() || it->second.signature != entry.second.signature ||
+          it->second.inlined != entry.second.inlined) {
+        changedNames.insert(entry.first);
+      }
+    }
+    bool again = false;
+    for (size_t i = 0; i < spans.size() && !again; i++) {
+      if (dirty[i]) {
+        continue;
+      }
+      for (auto identifier : spans[i].identifiers) {
+        again |= (changedNames.count(identifier) != 0);
+      }
+    }
+    if (!again) {
+      break;
+    }
+  }
+
+  recompiled = 0;
+  output.clear();
+  for (size_t i = 0; i < spans.size(); i++) {
+    if (dirty[i]) {
+      CachedFunction& entry = results[spans[i].name];
+      for (auto member : graph.components[graph.componentOf[i]]) {
+        entry.component = std::min(entry.component, spans[member].name);
+      }
+      cache[spans[i].name] = std::move(entry);
+      recompiled++;
+    }
+    output += cache[spans[i].name].code;
+  }
+  for (auto it = cache.begin(); it != cache.end();) {
+    it = (indexOf.count(it->first) == 0) ? cache.erase(it) : std::next(it);
+  }
+  return true;
+}
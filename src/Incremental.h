@@ -0,0 +1,73 @@
+#ifndef INCREMENTAL_H_
+#define INCREMENTAL_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "Type.h"
+#include "Interner.h"
+#include "Lowering.h"
+
+
+// Recompiles successive versions of one source. Top-level functions are
+// recognized by a hash of their tokens, and the inferred signature and
+// emitted C of a function are kept until its text changes, a function it
+// refers to changes signature or a function inlined into it changes. Only
+// those functions, and the ones inlined into them, are parsed, inferred
+// and emitted again; the rest of the source is only lexed.
+class IncrementalCompiler {
+ public:
+  explicit IncrementalCompiler(const ParseOptions& _options = ParseOptions()) : options(_options) {}
+
+  // output receives the C code of the whole source. On a syntax, name or
+  // type error the cached state is left as it was and false is returned
+  // with a message in error.
+  bool compile(std::string_view source, std::string& output, std::string& error);
+
+  // functions compiled again by the last call to compile
+  size_t recompiledCount() const { return recompiled; }
+
+ private:
+  struct CachedFunction {
+    uint64_t hash = 0;
+    std::vector<PrimitiveKind> params;
+    // meaningful only when closed
+    PrimitiveKind result = PrimitiveKind::Int;
+    // the signature was fixed by the function's own call graph component,
+    // so its callers cannot change its types
+    bool closed = false;
+    // printable resolved signature, compared to find the callers to redo
+    std::string signature;
+    // the body is copied into its callers, so they are redone when it
+    // changes and it is compiled along with them
+    bool inlined = false;
+    // smallest name in its call graph component; whether a function is
+    // recursive, and so inlined, changes with any function of it
+    SymbolId component = NoSymbol;
+    std::string code;
+  };
+
+  // top-level function found by the lexer-only scan of a source
+  struct FunctionSpan {
+    SymbolId name;
+    uint32_t begin, end;
+    uint64_t hash;
+    // distinct identifiers of the function, a superset of the functions it calls
+    std::vector<SymbolId> identifiers;
+  };
+
+  ParseOptions options;
+  // names of the cached functions and of identifiers in spans
+  Interner names;
+  std::unordered_map<SymbolId, CachedFunction> cache;
+  size_t recompiled = 0;
+
+  bool split(std::string_view source, std::vector<FunctionSpan>& spans);
+  bool compileDirty(std::string_view source, const std::vector<FunctionSpan>& spans, const std::vector<bool>& dirty,
+                    std::unordered_map<SymbolId, CachedFunction>& results, std::string& error);
+};
+
+#endif
@@ -0,0 +1,531 @@
+#include "Inlining.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "CallGraph.h"
+
+
+static bool isLiteral(NodeKind kind) {
+  return kind == NodeKind::IntLiteral || kind == NodeKind::CharLiteral || kind == NodeKind::BoolLiteral;
+}
+
+void Inliner::visit(NodeId node) {
+  rootScope = scopes[node];
+  NodeList list = ast.list(node);
+  functionNodes.assign(list.begin(), list.end());
+  for (uint32_t i = 0; i < functionNodes.size(); i++) {
+    // the first declaration wins on a collision, as in the symbol table
+    functionIndex.emplace(ast[functionNodes[i]].name, i);
+  }
+
+  std::vector<std::vector<uint32_t>> edges(functions.size());
+  for (size_t f = 0; f < functions.size(); f++) {
+    for (auto callee : functions[f].callees) {
+      if (callee != NoFunction) {
+        edges[f].push_back(callee);
+      }
+    }
+  }
+  CallGraph graph(std::move(edges));
+
+  inlinable.assign(functionNodes.size(), false);
+  for (auto& component : graph.components) {
+    for (auto function : component) {
+      inlineCalls(function);
+    }
+    uint32_t function = component[0];
+    auto& calls = graph.callees[function];
+    bool recursive = component.size() > 1 || std::find(calls.begin(), calls.end(), function) != calls.end();
+    if (!recursive) {
+      inlinable[function] = measure(function);
+    }
+  }
+
+  helpers.assign(functionNodes.size(), false);
+  for (uint32_t f = 0; f < functionNodes.size(); f++) {
+    currentFunction = f;
+    currentScope = scopes[functionNodes[f]];
+    markHelpers(ast[functionNodes[f]].operands[0]);
+  }
+}
+
+void Inliner::inlineCalls(uint32_t function) {
+  NodeId func = functionNodes[function];
+  currentFunction = function;
+  takenNames.clear();
+  collectNames(func, takenNames);
+  currentScope = scopes[func];
+  visitBlock(ast[func].operands[0]);
+}
+
+bool Inliner::measure(uint32_t function) {
+  NodeId func = functionNodes[function];
+  NodeId body = ast[func].operands[0];
+  if (functionIndex[ast[func].name] != function || ast[body].listSize == 0) {
+    return false;
+  }
+  NodeList statements = ast.list(body);
+  const Node& last = ast[statements[statements.size() - 1]];
+  if (last.kind != NodeKind::Return || last.operands[0] == NoNode || countReturns(body) != 1 ||
+      countNodes(body) > kMaxInlineNodes) {
+    return false;
+  }
+
+  // copies are declared by these types, so none may be left open, and
+  // floats have no literal to start a copy at
+  std::vector<ScopeId> functionScopes;
+  collectScopes(scopes[func], functionScopes);
+  for (auto scope : functionScopes) {
+    for (auto& symbol : scopeTable[scope].symbols) {
+      auto *type = symbol.type->resolved()->as<ConcreteType>();
+      if (type == nullptr || type->primitive == PrimitiveKind::Float) {
+        return false;
+      }
+    }
+  }
+  auto *signature = scopeTable.findSymbol(rootScope, ast[func].name)->resolved()->as<FunctionType>();
+  if (signature == nullptr || signature->to->resolved()->as<ConcreteType>() == nullptr) {
+    return false;
+  }
+
+  Callee& info = callees[function];
+  info.assignedParams.assign(ast[func].listSize, false);
+  currentScope = scopes[func];
+  scanCallee(body, function, info);
+  std::unordered_set<SymbolId> allNames;
+  collectNames(func, allNames);
+  info.allNames.assign(allNames.begin(), allNames.end());
+  return true;
+}
+
+void Inliner::scanCallee(NodeId node, uint32_t function, Callee& info) {
+  const Node& n = ast[node];
+  ScopeId saved = currentScope;
+  if (n.kind == NodeKind::Block || n.kind == NodeKind::If) {
+    currentScope = scopes[node];
+  }
+
+  ScopeId functionScope = scopes[functionNodes[function]];
+  if (n.kind == NodeKind::Assign && scopeTable.resolveScope(currentScope, n.name) == functionScope) {
+    NodeList params = ast.list(functionNodes[function]);
+    for (size_t i = 0; i < params.size(); i++) {
+      if (ast[params[i]].name == n.name) {
+        info.assignedParams[i] = true;
+      }
+    }
+  }
+  if (n.kind == NodeKind::VarRef && scopeTable.resolveScope(currentScope, n.name) == rootScope) {
+    info.rootNames.push_back(n.name);
+  }
+
+  for (auto operand : n.operands) {
+    if (operand != NoNode) {
+      scanCallee(operand, function, info);
+    }
+  }
+  for (auto item : ast.list(node)) {
+    scanCallee(item, function, info);
+  }
+  currentScope = saved;
+}
+
+void Inliner::visitBlock(NodeId node) {
+  ScopeId savedScope = currentScope;
+  ScopeId savedBlock = blockScope;
+  currentScope = blockScope = scopes[node];
+
+  NodeList list = ast.list(node);
+  std::vector<NodeId> original(list.begin(), list.end());
+  std::vector<NodeId> statements;
+  for (auto stmt : original) {
+    visitStatement(stmt, statements);
+  }
+  if (statements != original) {
+    ast.setList(node, statements);
+  }
+
+  currentScope = savedScope;
+  blockScope = savedBlock;
+}
+
+// appends the statements replacing node to statements
+void Inliner::visitStatement(NodeId node, std::vector<NodeId>& statements) {
+  switch (ast[node].kind) {
+    case NodeKind::Block:
+      visitBlock(node);
+      break;
+
+    case NodeKind::If: {
+      ScopeId saved = currentScope;
+      currentScope = scopes[node];
+      NodeId condition = expand(ast[node].operands[0], statements);
+      ast[node].operands[0] = condition;
+      visitBlock(ast[node].operands[1]);
+      if (ast[node].operands[2] != NoNode) {
+        visitElse(ast[node].operands[2]);
+      }
+      currentScope = saved;
+      break;
+    }
+
+    case NodeKind::VarDecl:
+    case NodeKind::Assign:
+    case NodeKind::Return:
+    case NodeKind::ExprStmt: {
+      if (ast[node].operands[0] == NoNode) {
+        break;
+      }
+      size_t before = inlinedCalls;
+      NodeId value = expand(ast[node].operands[0], statements);
+      ast[node].operands[0] = value;
+      if (ast[node].kind == NodeKind::ExprStmt && inlinedCalls != before && !hasEffects(value)) {
+        // the copied statements did all the work
+        return;
+      }
+      break;
+    }
+
+    default:
+      break;
+  }
+  statements.push_back(node);
+}
+
+void Inliner::visitElse(NodeId node) {
+  if (ast[node].kind != NodeKind::If) {
+    visitBlock(node);
+    return;
+  }
+  ScopeId saved = currentScope;
+  currentScope = scopes[node];
+  visitBlock(ast[node].operands[1]);
+  if (ast[node].operands[2] != NoNode) {
+    visitElse(ast[node].operands[2]);
+  }
+  currentScope = saved;
+}
+
+NodeId Inliner::expand(NodeId node, std::vector<NodeId>& statements) {
+  switch (ast[node].kind) {
+    case NodeKind::Call: {
+      // arguments first, so the innermost calls are copied first
+      for (uint32_t i = 0; i < ast[node].listSize; i++) {
+        NodeId arg = expand(ast.lists[ast[node].listBegin + i], statements);
+        ast.lists[ast[node].listBegin + i] = arg;
+      }
+      const Node& target = ast[ast[node].operands[0]];
+      if (target.kind != NodeKind::VarRef || scopeTable.resolveScope(currentScope, target.name) != rootScope) {
+        return node;
+      }
+      auto it = functionIndex.find(target.name);
+      if (it == functionIndex.end() || it->second == currentFunction || !inlinable[it->second]) {
+        return node;
+      }
+      return inlineCall(node, it->second, statements);
+    }
+
+    case NodeKind::VarRef:
+    case NodeKind::IntLiteral:
+    case NodeKind::CharLiteral:
+    case NodeKind::BoolLiteral:
+      return node;
+
+    default:
+      for (int i = 0; i < 3; i++) {
+        if (ast[node].operands[i] != NoNode) {
+          NodeId operand = expand(ast[node].operands[i], statements);
+          ast[node].operands[i] = operand;
+        }
+      }
+      return node;
+  }
+}
+
+NodeId Inliner::inlineCall(NodeId call, uint32_t callee, std::vector<NodeId>& statements) {
+  const Callee& info = callees[callee];
+  // a local of the caller may hide a function the callee calls
+  for (auto name : info.rootNames) {
+    if (scopeTable.resolveScope(currentScope, name) != rootScope) {
+      return call;
+    }
+  }
+  takenNames.insert(info.allNames.begin(), info.allNames.end());
+
+  NodeId func = functionNodes[callee];
+  SymbolId functionName = ast[func].name;
+  ScopeId functionScope = scopes[func];
+  NodeId body = ast[func].operands[0];
+  calleeFunctionScope = functionScope;
+  renamed.clear();
+  substituted.clear();
+
+  std::vector<ScopeId> bodyScopes;
+  collectScopes(scopes[body], bodyScopes);
+  for (auto scope : bodyScopes) {
+    for (auto& symbol : scopeTable[scope].symbols) {
+      SymbolId fresh = freshName(functionName, symbol.name);
+      scopeTable.addSymbol(blockScope, fresh, symbol.type);
+      renamed[symbolKey(scope, symbol.name)] = fresh;
+    }
+  }
+
+  NodeList paramList = ast.list(func);
+  NodeList argList = ast.list(call);
+  std::vector<NodeId> params(paramList.begin(), paramList.end());
+  std::vector<NodeId> args(argList.begin(), argList.end());
+  for (size_t i = 0; i < params.size(); i++) {
+    SymbolId param = ast[params[i]].name;
+    NodeKind kind = ast[args[i]].kind;
+    if ((isLiteral(kind) || kind == NodeKind::VarRef) && !info.assignedParams[i]) {
+      substituted[param] = args[i];
+      continue;
+    }
+    SymbolId fresh = freshName(functionName, param);
+    scopeTable.addSymbol(blockScope, fresh, scopeTable.findEntry(functionScope, param)->type);
+    renamed[symbolKey(functionScope, param)] = fresh;
+    NodeId decl = ast.addNode(NodeKind::VarDecl);
+    ast[decl].name = fresh;
+    ast[decl].operands[0] = args[i];
+    scopes.grow(ast);
+    nodeTypes.grow(ast);
+    statements.push_back(decl);
+  }
+
+  NodeList bodyList = ast.list(body);
+  std::vector<NodeId> bodyStatements(bodyList.begin(), bodyList.end());
+  calleeScope = scopes[body];
+  for (size_t i = 0; i + 1 < bodyStatements.size(); i++) {
+    statements.push_back(clone(bodyStatements[i], blockScope));
+  }
+  NodeId result = clone(ast[bodyStatements.back()].operands[0], blockScope);
+  inlinedCalls++;
+  return result;
+}
+
+NodeId Inliner::copy(NodeId from) {
+  NodeId id = ast.addNode(ast[from].kind);
+  ast[id] = ast[from];
+  scopes.grow(ast);
+  nodeTypes.grow(ast);
+  nodeTypes[id] = nodeTypes[from];
+  return id;
+}
+
+// copy of a callee node for the caller, placed in scope parent. Blocks
+// and ifs get new, empty scopes, since every local moved to blockScope.
+NodeId Inliner::clone(NodeId node, ScopeId parent) {
+  NodeKind kind = ast[node].kind;
+  switch (kind) {
+    case NodeKind::Block:
+    case NodeKind::If: {
+      NodeId id = copy(node);
+      ScopeId scope = scopeTable.addScope(BLOCK, parent);
+      scopes[id] = scope;
+      ScopeId saved = calleeScope;
+      calleeScope = scopes[node];
+      if (kind == NodeKind::Block) {
+        NodeList list = ast.list(node);
+        std::vector<NodeId> original(list.begin(), list.end());
+        std::vector<NodeId> items;
+        for (auto stmt : original) {
+          items.push_back(clone(stmt, scope));
+        }
+        ast.setList(id, items);
+      }
+      else {
+        for (int i = 0; i < 3; i++) {
+          if (ast[node].operands[i] != NoNode) {
+            NodeId operand = clone(ast[node].operands[i], scope);
+            ast[id].operands[i] = operand;
+          }
+        }
+      }
+      calleeScope = saved;
+      return id;
+    }
+
+    case NodeKind::VarRef: {
+      auto it = substituted.find(ast[node].name);
+      if (it != substituted.end() && scopeTable.resolveScope(calleeScope, ast[node].name) == calleeFunctionScope) {
+        return copy(it->second);
+      }
+      NodeId id = copy(node);
+      ast[id].name = renamedSymbol(calleeScope, ast[node].name);
+      return id;
+    }
+
+    case NodeKind::VarDecl: {
+      NodeId id = copy(node);
+      SymbolId name = renamedSymbol(calleeScope, ast[node].name);
+      ast[id].name = name;
+      NodeId value = (ast[node].operands[0] != NoNode) ? clone(ast[node].operands[0], parent) : NoNode;
+      if (parent != blockScope) {
+        // declared in blockScope, so a nested declaration only assigns,
+        // and one without a value sets the zero the VM starts it at
+        ast[id].kind = NodeKind::Assign;
+        if (value == NoNode) {
+          value = zeroOf(scopeTable.findEntry(blockScope, name)->type);
+        }
+      }
+      ast[id].operands[0] = value;
+      return id;
+    }
+
+    case NodeKind::Call: {
+      NodeId id = copy(node);
+      NodeId target = clone(ast[node].operands[0], parent);
+      ast[id].operands[0] = target;
+      NodeList list = ast.list(node);
+      std::vector<NodeId> original(list.begin(), list.end());
+      std::vector<NodeId> args;
+      for (auto arg : original) {
+        args.push_back(clone(arg, parent));
+      }
+      ast.setList(id, args);
+      return id;
+    }
+
+    default: {
+      NodeId id = copy(node);
+      if (ast[id].name != NoSymbol) {
+        ast[id].name = renamedSymbol(calleeScope, ast[node].name);
+      }
+      for (int i = 0; i < 3; i++) {
+        if (ast[node].operands[i] != NoNode) {
+          NodeId operand = clone(ast[node].operands[i], parent);
+          ast[id].operands[i] = operand;
+        }
+      }
+      return id;
+    }
+  }
+}
+
+NodeId Inliner::zeroOf(Type *type) {
+  NodeKind kind;
+  switch (type->resolved()->as<ConcreteType>()->primitive) {
+    case PrimitiveKind::Char: kind = NodeKind::CharLiteral; break;
+    case PrimitiveKind::Bool: kind = NodeKind::BoolLiteral; break;
+    default: kind = NodeKind::IntLiteral; break;
+  }
+  NodeId id = ast.addNode(kind);
+  scopes.grow(ast);
+  nodeTypes.grow(ast);
+  nodeTypes[id] = type;
+  return id;
+}
+
+SymbolId Inliner::freshName(SymbolId function, SymbolId name) {
+  std::string base = names.name(function) + "_" + names.name(name);
+  std::string candidate = base;
+  SymbolId id = names.intern(candidate);
+  for (int k = 2; takenNames.count(id) != 0; k++) {
+    candidate = base + "_" + std::to_string(k);
+    id = names.intern(candidate);
+  }
+  takenNames.insert(id);
+  return id;
+}
+
+SymbolId Inliner::renamedSymbol(ScopeId scope, SymbolId name) {
+  auto it = renamed.find(symbolKey(scopeTable.resolveScope(scope, name), name));
+  return (it != renamed.end()) ? it->second : name;
+}
+
+void Inliner::collectNames(NodeId node, std::unordered_set<SymbolId>& out) const {
+  const Node& n = ast[node];
+  if (n.name != NoSymbol) {
+    out.insert(n.name);
+  }
+  for (auto operand : n.operands) {
+    if (operand != NoNode) {
+      collectNames(operand, out);
+    }
+  }
+  for (auto item : ast.list(node)) {
+    collectNames(item, out);
+  }
+}
+
+void Inliner::collectScopes(ScopeId scope, std::vector<ScopeId>& out) {
+  out.push_back(scope);
+  for (auto child : scopeTable[scope].children) {
+    collectScopes(child, out);
+  }
+}
+
+size_t Inliner::countNodes(NodeId node) const {
+  size_t count = 1;
+  for (auto operand : ast[node].operands) {
+    if (operand != NoNode) {
+      count += countNodes(operand);
+    }
+  }
+  for (auto item : ast.list(node)) {
+    count += countNodes(item);
+  }
+  return count;
+}
+
+size_t Inliner::countReturns(NodeId node) const {
+  const Node& n = ast[node];
+  switch (n.kind) {
+    case NodeKind::Return:
+      return 1;
+
+    case NodeKind::Block: {
+      size_t count = 0;
+      for (auto stmt : ast.list(node)) {
+        count += countReturns(stmt);
+      }
+      return count;
+    }
+
+    case NodeKind::If:
+      return countReturns(n.operands[1]) + ((n.operands[2] != NoNode) ? countReturns(n.operands[2]) : 0);
+
+    default:
+      return 0;
+  }
+}
+
+bool Inliner::hasEffects(NodeId node) const {
+  const Node& n = ast[node];
+  if (n.kind == NodeKind::Call || n.kind == NodeKind::Div) {
+    return true;
+  }
+  for (auto operand : n.operands) {
+    if (operand != NoNode && hasEffects(operand)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Inliner::markHelpers(NodeId node) {
+  const Node& n = ast[node];
+  ScopeId saved = currentScope;
+  if (n.kind == NodeKind::Block || n.kind == NodeKind::If) {
+    currentScope = scopes[node];
+  }
+  if (n.kind == NodeKind::Call && ast[n.operands[0]].kind == NodeKind::VarRef) {
+    SymbolId name = ast[n.operands[0]].name;
+    auto it = functionIndex.find(name);
+    if (it != functionIndex.end() && it->second != currentFunction &&
+        scopeTable.resolveScope(currentScope, name) == rootScope) {
+      helpers[it->second] = true;
+    }
+  }
+
+  for (auto operand : n.operands) {
+    if (operand != NoNode) {
+      markHelpers(operand);
+    }
+  }
+  for (auto item : ast.list(node)) {
+    markHelpers(item);
+  }
+  currentScope = saved;
+}
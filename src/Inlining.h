@@ -0,0 +1,114 @@
+#ifndef INLINING_H_
+#define INLINING_H_
+
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstddef>
+#include <cstdint>
+
+#include "Type.h"
+#include "Interner.h"
+#include "AST.h"
+#include "SymbolTable.h"
+#include "HMTypeInference.h"
+
+
+// Copies the bodies of small functions into their callers in an inferred
+// Ast. A function is inlined when its body has at most kMaxInlineNodes
+// nodes, ends in its only return, has concrete types and is not part of a
+// call graph cycle. Callers are visited callees first, so a function is
+// measured after its own calls were inlined.
+//
+// A call is replaced where a statement of a block evaluates it: in a
+// declaration, assignment, return, expression statement or the condition
+// of an if. Else-if conditions are only evaluated on some paths and are
+// left alone. The copied statements go in front of that statement, which
+// is safe because calls have no effects besides the values they return.
+// Arguments are bound to new locals unless they are literals or variables
+// the callee never assigns to, which are substituted. Every local of a
+// copy gets a name new to the caller, derived from the callee's name and
+// its own, and is declared in the block receiving the copy.
+class Inliner {
+ public:
+  Inliner(Ast& _ast, ScopeMap& _scopes, ScopeTable& _scopeTable, Interner& _names, NodeTable<Type*>& _nodeTypes,
+          const std::vector<FunctionConstraints>& _functions)
+    : ast(_ast), scopes(_scopes), scopeTable(_scopeTable), names(_names), nodeTypes(_nodeTypes),
+      functions(_functions) {}
+
+  static constexpr size_t kMaxInlineNodes = 40;
+
+  Ast& ast;
+  ScopeMap& scopes;
+  ScopeTable& scopeTable;
+  Interner& names;
+  NodeTable<Type*>& nodeTypes;
+  const std::vector<FunctionConstraints>& functions;
+
+  size_t inlinedCalls = 0;
+
+  // per top-level function: its body is copied into callers
+  std::vector<bool> inlinable;
+  // per top-level function: another function still calls it afterwards
+  std::vector<bool> helpers;
+
+  void visit(NodeId node);
+
+ private:
+  // what a call site needs to know about an inlinable function
+  struct Callee {
+    // per parameter: assigned in the body, so it always gets its own local
+    std::vector<bool> assignedParams;
+    // names the body refers to at the root scope, i.e. functions
+    std::vector<SymbolId> rootNames;
+    // every name in the body
+    std::vector<SymbolId> allNames;
+  };
+
+  std::vector<NodeId> functionNodes;
+  std::unordered_map<SymbolId, uint32_t> functionIndex;
+  std::unordered_map<uint32_t, Callee> callees;
+  ScopeId rootScope;
+
+  // state of the caller being rewritten
+  uint32_t currentFunction;
+  ScopeId currentScope;
+  // scope of the block receiving copied statements
+  ScopeId blockScope;
+  std::unordered_set<SymbolId> takenNames;
+
+  // state of the copy being made, keyed by callee scope and name
+  std::unordered_map<uint64_t, SymbolId> renamed;
+  std::unordered_map<SymbolId, NodeId> substituted;
+  ScopeId calleeScope;
+  ScopeId calleeFunctionScope;
+
+  uint64_t symbolKey(ScopeId scope, SymbolId name) const { return (uint64_t(scope) << 32) | name; }
+
+  void inlineCalls(uint32_t function);
+  bool measure(uint32_t function);
+  void scanCallee(NodeId node, uint32_t function, Callee& info);
+
+  void visitBlock(NodeId node);
+  void visitStatement(NodeId node, std::vector<NodeId>& statements);
+  void visitElse(NodeId node);
+  // node or the expression replacing it
+  NodeId expand(NodeId node, std::vector<NodeId>& statements);
+  NodeId inlineCall(NodeId call, uint32_t callee, std::vector<NodeId>& statements);
+
+  NodeId copy(NodeId from);
+  NodeId clone(NodeId node, ScopeId parent);
+  NodeId zeroOf(Type *type);
+  SymbolId freshName(SymbolId function, SymbolId name);
+  SymbolId renamedSymbol(ScopeId scope, SymbolId name);
+
+  void collectNames(NodeId node, std::unordered_set<SymbolId>& out) const;
+  void collectScopes(ScopeId scope, std::vector<ScopeId>& out);
+  size_t countNodes(NodeId node) const;
+  size_t countReturns(NodeId node) const;
+  // a call or a division, which may trap
+  bool hasEffects(NodeId node) const;
+  void markHelpers(NodeId node);
+};
+
+#endif
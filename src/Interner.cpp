@@ -0,0 +1,16 @@
+#include <string>
+#include <string_view>
+
+#include "Interner.h"
+
+
+SymbolId Interner::intern(std::string_view name) {
+  auto it = ids.find(name);
+  if (it != ids.end()) {
+    return it->second;
+  }
+  SymbolId id = names.size();
+  names.emplace_back(name);
+  ids.emplace(names.back(), id);
+  return id;
+}
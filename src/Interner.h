@@ -0,0 +1,28 @@
+#ifndef INTERNER_H_
+#define INTERNER_H_
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
+#include <cstdint>
+
+
+// Interned identifier. Two identifiers are the same name iff their ids are equal.
+using SymbolId = uint32_t;
+constexpr SymbolId NoSymbol = UINT32_MAX;
+
+class Interner {
+ public:
+  SymbolId intern(std::string_view name);
+
+  const std::string& name(SymbolId id) const { return names[id]; }
+  size_t size() const { return names.size(); }
+
+ private:
+  // deque keeps every string at a stable address, so the map can key on views of them
+  std::deque<std::string> names;
+  std::unordered_map<std::string_view, SymbolId> ids;
+};
+
+#endif
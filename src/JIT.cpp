@@ -0,0 +1,750 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <initializer_list>
+#include <climits>
+#include <csetjmp>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+#include "Bytecode.h"
+#include "JIT.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_X86_64 1
+#include <sys/mman.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef JIT_X86_64
+
+namespace {
+
+// Runtime errors leave native code by longjmp to the innermost
+// JitProgram::call of the thread; the jmp_buf restores the callee-saved
+// registers the JITed frames were holding.
+struct TrapContext {
+  jmp_buf buffer;
+};
+
+enum Trap {
+  DivisionByZero = 1,
+  StackOverflow = 2,
+};
+
+thread_local TrapContext *activeTrap = nullptr;
+
+// JITed prologues compare rsp against this through fs; 0 disables the check
+thread_local uintptr_t stackLimit = 0;
+
+[[noreturn]] void trap(int kind) {
+  if (activeTrap == nullptr) {
+    std::fprintf(stderr, "%s in JIT code\n", kind == DivisionByZero ? "division by zero" : "stack overflow");
+    std::abort();
+  }
+  longjmp(activeTrap->buffer, kind);
+}
+
+// offset of stackLimit from the thread pointer, the same in every thread
+// for the static TLS block of the executable
+int32_t stackLimitOffset() {
+  uintptr_t threadPointer;
+  asm("mov %%fs:0, %0" : "=r"(threadPointer));
+  return static_cast<int32_t>(reinterpret_cast<uintptr_t>(&stackLimit) - threadPointer);
+}
+
+// lowest rsp JITed code may reach on this thread, with room left for
+// trap and the C code it calls
+uintptr_t threadStackLimit() {
+  thread_local uintptr_t limit = 0;
+  if (limit == 0) {
+    pthread_attr_t attr;
+    void *low = nullptr;
+    size_t size = 0;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+      pthread_attr_getstack(&attr, &low, &size);
+      pthread_attr_destroy(&attr);
+    }
+    limit = reinterpret_cast<uintptr_t>(low) + 256 * 1024;
+  }
+  return limit;
+}
+
+enum Reg : uint8_t {
+  RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+const Reg argumentRegs[] = { RDI, RSI, RDX, RCX, R8, R9 };
+const int MaxArguments = 6;
+
+// rax and rdx are taken by arithmetic and division, r11 by moves, so they
+// are never allocated. Caller-saved registers only hold values that are
+// not live across a call.
+const Reg calleeSaved[] = { RBX, R12, R13, R14, R15 };
+const Reg callerSaved[] = { RSI, RDI, RCX, R8, R9, R10 };
+
+// where a bytecode register lives: a machine register or [rbp + offset]
+struct Location {
+  bool inRegister = true;
+  Reg reg = RAX;
+  int32_t offset = 0;
+
+  bool operator==(const Location& other) const {
+    return inRegister == other.inRegister && (inRegister ? reg == other.reg : offset == other.offset);
+  }
+  bool operator!=(const Location& other) const { return !(*this == other); }
+};
+
+Location in(Reg reg) {
+  Location location;
+  location.reg = reg;
+  return location;
+}
+
+Location frameSlot(int32_t offset) {
+  Location location;
+  location.inRegister = false;
+  location.offset = offset;
+  return location;
+}
+
+// condition codes of jcc and setcc
+enum Condition : uint8_t {
+  Below = 0x2,
+  Equal = 0x4,
+  NotEqual = 0x5,
+};
+
+class Assembler {
+ public:
+  std::vector<uint8_t> bytes;
+
+  uint32_t position() const { return bytes.size(); }
+
+  void byte(uint8_t value) { bytes.push_back(value); }
+  void dword(uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+      byte(value >> (8 * i));
+    }
+  }
+  void qword(uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+      byte(value >> (8 * i));
+    }
+  }
+
+  // [REX] opcode ModRM [disp32]; reg is a register or an opcode extension
+  void op(bool wide, std::initializer_list<uint8_t> opcode, int reg, Location rm) {
+    uint8_t rex = 0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm.inRegister && (rm.reg & 8)) ? 1 : 0);
+    if (rex != 0x40) {
+      byte(rex);
+    }
+    for (uint8_t value : opcode) {
+      byte(value);
+    }
+    if (rm.inRegister) {
+      byte(0xC0 | ((reg & 7) << 3) | (rm.reg & 7));
+    }
+    else {
+      byte(0x80 | ((reg & 7) << 3) | RBP);
+      dword(rm.offset);
+    }
+  }
+
+  void move(Location to, Location from) {
+    if (to == from) {
+      return;
+    }
+    if (!to.inRegister && !from.inRegister) {
+      op(true, { 0x8B }, RAX, from);
+      from = in(RAX);
+    }
+    if (to.inRegister) {
+      op(true, { 0x8B }, to.reg, from);
+    }
+    else {
+      op(true, { 0x89 }, from.reg, to);
+    }
+  }
+
+  void moveImmediate(Location to, int32_t value) {
+    op(true, { 0xC7 }, 0, to);
+    dword(value);
+  }
+
+  // 32-bit load, and sign extension of eax back to 64 bits
+  void load32(Reg to, Location from) { op(false, { 0x8B }, to, from); }
+  void extendEax() { op(true, { 0x63 }, RAX, in(RAX)); }
+
+  // al = condition, zero-extended to eax
+  void setFlag(Condition condition) {
+    op(false, { 0x0F, uint8_t(0x90 | condition) }, 0, in(RAX));
+    op(false, { 0x0F, 0xB6 }, RAX, in(RAX));
+  }
+
+  void push(Reg reg) {
+    if (reg & 8) {
+      byte(0x41);
+    }
+    byte(0x50 | (reg & 7));
+  }
+  void pop(Reg reg) {
+    if (reg & 8) {
+      byte(0x41);
+    }
+    byte(0x58 | (reg & 7));
+  }
+
+  // the rel32 fields are returned for patch
+  uint32_t jump() {
+    byte(0xE9);
+    dword(0);
+    return position() - 4;
+  }
+  uint32_t jumpIf(Condition condition) {
+    byte(0x0F);
+    byte(0x80 | condition);
+    dword(0);
+    return position() - 4;
+  }
+  uint32_t call() {
+    byte(0xE8);
+    dword(0);
+    return position() - 4;
+  }
+
+  void patch(uint32_t field, uint32_t target) {
+    uint32_t relative = target - (field + 4);
+    std::memcpy(&bytes[field], &relative, 4);
+  }
+};
+
+struct Interval {
+  int start = INT_MAX;
+  int end = -1;
+  bool crossesCall = false;
+
+  bool used() const { return end >= 0; }
+};
+
+struct Relocation {
+  uint32_t field;
+  uint32_t target;
+};
+
+class FunctionCompiler {
+ public:
+  // the function's code is program.code[_begin, _end)
+  FunctionCompiler(const BytecodeProgram& _program, uint32_t _function, uint32_t _begin, uint32_t _end,
+                   Assembler& _assembler)
+    : program(_program), function(program.functions[_function]), assembler(_assembler), begin(_begin), end(_end) {
+  }
+
+  std::vector<Relocation> calls;
+  std::vector<Relocation> divisionTraps;
+  std::vector<Relocation> stackTraps;
+
+  void compile(int32_t limitOffset) {
+    computeIntervals();
+    allocate();
+    emitPrologue(limitOffset);
+    emitBody();
+  }
+
+ private:
+  const BytecodeProgram& program;
+  const BytecodeFunction& function;
+  Assembler& assembler;
+  uint32_t begin;
+  uint32_t end;
+
+  std::vector<Interval> intervals;
+  std::vector<Location> locations;
+  std::vector<Reg> saved;
+  int spillSlots = 0;
+
+  void touch(uint16_t reg, int index) {
+    Interval& interval = intervals[reg];
+    interval.start = std::min(interval.start, index);
+    interval.end = std::max(interval.end, index);
+  }
+
+  // Jumps only go forward, so a value is live from the first to the last
+  // instruction that mentions its register.
+  void computeIntervals() {
+    intervals.assign(function.registerCount, Interval());
+    for (size_t i = 0; i < function.params.size(); i++) {
+      touch(i, -1);
+    }
+
+    std::vector<int> callIndexes;
+    for (uint32_t pc = begin; pc < end; pc++) {
+      const Instruction& ins = program.code[pc];
+      int index = pc - begin;
+      switch (ins.op) {
+        case Opcode::Add:
+        case Opcode::Sub:
+        case Opcode::Mul:
+        case Opcode::Div:
+        case Opcode::Equal:
+          touch(ins.c, index);
+          // fall through
+        case Opcode::Move:
+        case Opcode::Negate:
+        case Opcode::Not:
+          touch(ins.b, index);
+          // fall through
+        case Opcode::LoadConst:
+        case Opcode::TruncChar:
+        case Opcode::JumpIfFalse:
+        case Opcode::Return:
+          touch(ins.a, index);
+          break;
+        case Opcode::Call: {
+          size_t count = program.functions[ins.wide()].params.size();
+          touch(ins.a, index);
+          for (size_t i = 1; i < count; i++) {
+            touch(ins.a + i, index);
+          }
+          callIndexes.push_back(index);
+          break;
+        }
+        case Opcode::Jump:
+          break;
+      }
+    }
+
+    for (auto& interval : intervals) {
+      auto call = std::upper_bound(callIndexes.begin(), callIndexes.end(), interval.start);
+      interval.crossesCall = call != callIndexes.end() && *call < interval.end;
+    }
+  }
+
+  // Linear scan: intervals in order of start, each taking a free register
+  // (caller-saved first unless it lives across a call). With none free,
+  // the interval ending last among the active ones and this one goes to
+  // a stack slot for its whole life.
+  void allocate() {
+    locations.assign(function.registerCount, Location());
+    std::vector<uint32_t> order;
+    for (uint32_t reg = 0; reg < intervals.size(); reg++) {
+      if (intervals[reg].used()) {
+        order.push_back(reg);
+      }
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](uint32_t x, uint32_t y) { return intervals[x].start < intervals[y].start; });
+
+    std::vector<Reg> freeCallee(std::rbegin(calleeSaved), std::rend(calleeSaved));
+    std::vector<Reg> freeCaller(std::rbegin(callerSaved), std::rend(callerSaved));
+    std::vector<uint32_t> active;
+    bool used[16] = {};
+
+    auto release = [&](Reg reg) {
+      bool callee = std::find(std::begin(calleeSaved), std::end(calleeSaved), reg) != std::end(calleeSaved);
+      (callee ? freeCallee : freeCaller).push_back(reg);
+    };
+    auto spill = [&]() { return frameSlot(-8 * ++spillSlots); };
+
+    for (uint32_t current : order) {
+      const Interval& interval = intervals[current];
+      active.erase(std::remove_if(active.begin(), active.end(), [&](uint32_t other) {
+        if (intervals[other].end < interval.start) {
+          release(locations[other].reg);
+          return true;
+        }
+        return false;
+      }), active.end());
+
+      std::vector<Reg> *pool = nullptr;
+      if (!interval.crossesCall && !freeCaller.empty()) {
+        pool = &freeCaller;
+      }
+      else if (!freeCallee.empty()) {
+        pool = &freeCallee;
+      }
+      if (pool) {
+        locations[current] = in(pool->back());
+        used[pool->back()] = true;
+        pool->pop_back();
+        active.push_back(current);
+        continue;
+      }
+
+      // steal from the active interval that ends last, if its register suits
+      uint32_t victim = UINT32_MAX;
+      for (uint32_t other : active) {
+        bool suits = !interval.crossesCall ||
+          std::find(std::begin(calleeSaved), std::end(calleeSaved), locations[other].reg) != std::end(calleeSaved);
+        if (suits && (victim == UINT32_MAX || intervals[other].end > intervals[victim].end)) {
+          victim = other;
+        }
+      }
+      if (victim != UINT32_MAX && intervals[victim].end > interval.end) {
+        locations[current] = locations[victim];
+        locations[victim] = spill();
+        std::replace(active.begin(), active.end(), victim, current);
+      }
+      else {
+        locations[current] = spill();
+      }
+    }
+
+    for (Reg reg : calleeSaved) {
+      if (used[reg]) {
+        saved.push_back(reg);
+      }
+    }
+    // spill slots sit below the saved registers
+    for (auto& location : locations) {
+      if (!location.inRegister) {
+        location.offset -= 8 * saved.size();
+      }
+    }
+  }
+
+  // Copies every source to its destination as if at once; r11 breaks cycles.
+  void parallelMove(std::vector<std::pair<Location, Location>> moves) {
+    moves.erase(std::remove_if(moves.begin(), moves.end(),
+                               [](auto& move) { return move.first == move.second; }), moves.end());
+    while (!moves.empty()) {
+      bool progress = false;
+      for (size_t i = 0; i < moves.size(); i++) {
+        bool blocked = false;
+        for (size_t j = 0; j < moves.size(); j++) {
+          if (j != i && moves[j].second == moves[i].first) {
+            blocked = true;
+            break;
+          }
+        }
+        if (!blocked) {
+          assembler.move(moves[i].first, moves[i].second);
+          moves.erase(moves.begin() + i);
+          progress = true;
+          break;
+        }
+      }
+      if (!progress) {
+        Location destination = moves.front().first;
+        assembler.move(in(R11), destination);
+        for (auto& move : moves) {
+          if (move.second == destination) {
+            move.second = in(R11);
+          }
+        }
+      }
+    }
+  }
+
+  void emitPrologue(int32_t limitOffset) {
+    assembler.push(RBP);
+    assembler.move(in(RBP), in(RSP));
+    for (Reg reg : saved) {
+      assembler.push(reg);
+    }
+    // rsp is 16-byte aligned at every call
+    uint32_t frameBytes = 8 * spillSlots;
+    if ((saved.size() + spillSlots) % 2) {
+      frameBytes += 8;
+    }
+    if (frameBytes) {
+      assembler.op(true, { 0x81 }, 5, in(RSP));
+      assembler.dword(frameBytes);
+    }
+
+    // cmp rsp, fs:[limitOffset]
+    assembler.byte(0x64);
+    assembler.byte(0x48);
+    assembler.byte(0x3B);
+    assembler.byte(0x24);
+    assembler.byte(0x25);
+    assembler.dword(limitOffset);
+    stackTraps.push_back({ assembler.jumpIf(Below), 0 });
+
+    std::vector<std::pair<Location, Location>> moves;
+    for (size_t i = 0; i < function.params.size(); i++) {
+      if (intervals[i].used()) {
+        moves.push_back({ locations[i], in(argumentRegs[i]) });
+      }
+    }
+    parallelMove(moves);
+  }
+
+  void emitEpilogue() {
+    if (saved.empty()) {
+      assembler.move(in(RSP), in(RBP));
+    }
+    else {
+      assembler.op(true, { 0x8D }, RSP, frameSlot(-8 * saved.size()));
+      for (size_t i = saved.size(); i-- > 0;) {
+        assembler.pop(saved[i]);
+      }
+    }
+    assembler.pop(RBP);
+    assembler.byte(0xC3);
+  }
+
+  // eax = b op c, sign-extended into a
+  void emitArithmetic(std::initializer_list<uint8_t> opcode, const Instruction& ins) {
+    assembler.load32(RAX, locations[ins.b]);
+    assembler.op(false, opcode, RAX, locations[ins.c]);
+    assembler.extendEax();
+    assembler.move(locations[ins.a], in(RAX));
+  }
+
+  void emitBody() {
+    // a jump may target the end of the function
+    std::vector<uint32_t> offsets(end - begin + 1);
+    std::vector<Relocation> jumps;
+
+    for (uint32_t pc = begin; pc < end; pc++) {
+      const Instruction& ins = program.code[pc];
+      offsets[pc - begin] = assembler.position();
+      switch (ins.op) {
+        case Opcode::Move:
+          assembler.move(locations[ins.a], locations[ins.b]);
+          break;
+        case Opcode::LoadConst:
+          assembler.moveImmediate(locations[ins.a], static_cast<int32_t>(program.constants[ins.wide()]));
+          break;
+        case Opcode::Add:
+          emitArithmetic({ 0x03 }, ins);
+          break;
+        case Opcode::Sub:
+          emitArithmetic({ 0x2B }, ins);
+          break;
+        case Opcode::Mul:
+          emitArithmetic({ 0x0F, 0xAF }, ins);
+          break;
+        case Opcode::Div: {
+          assembler.load32(R11, locations[ins.c]);
+          assembler.op(false, { 0x85 }, R11, in(R11));
+          divisionTraps.push_back({ assembler.jumpIf(Equal), 0 });
+          assembler.load32(RAX, locations[ins.b]);
+          // INT_MIN / -1 traps in idiv; it wraps like the other operators
+          assembler.op(false, { 0x83 }, 7, in(R11));
+          assembler.byte(0xFF);
+          uint32_t divide = assembler.jumpIf(NotEqual);
+          assembler.op(false, { 0xF7 }, 3, in(RAX));
+          uint32_t done = assembler.jump();
+          assembler.patch(divide, assembler.position());
+          assembler.byte(0x99);
+          assembler.op(false, { 0xF7 }, 7, in(R11));
+          assembler.patch(done, assembler.position());
+          assembler.extendEax();
+          assembler.move(locations[ins.a], in(RAX));
+          break;
+        }
+        case Opcode::Negate:
+          assembler.load32(RAX, locations[ins.b]);
+          assembler.op(false, { 0xF7 }, 3, in(RAX));
+          assembler.extendEax();
+          assembler.move(locations[ins.a], in(RAX));
+          break;
+        case Opcode::Not:
+          assembler.move(in(RAX), locations[ins.b]);
+          assembler.op(true, { 0x85 }, RAX, in(RAX));
+          assembler.setFlag(Equal);
+          assembler.move(locations[ins.a], in(RAX));
+          break;
+        case Opcode::Equal:
+          assembler.move(in(RAX), locations[ins.b]);
+          assembler.op(true, { 0x3B }, RAX, locations[ins.c]);
+          assembler.setFlag(Equal);
+          assembler.move(locations[ins.a], in(RAX));
+          break;
+        case Opcode::TruncChar:
+          assembler.move(in(RAX), locations[ins.a]);
+          assembler.op(true, { 0x0F, 0xBE }, RAX, in(RAX));
+          assembler.move(locations[ins.a], in(RAX));
+          break;
+        case Opcode::Jump:
+          jumps.push_back({ assembler.jump(), ins.wide() });
+          break;
+        case Opcode::JumpIfFalse:
+          assembler.op(true, { 0x83 }, 7, locations[ins.a]);
+          assembler.byte(0);
+          jumps.push_back({ assembler.jumpIf(Equal), ins.wide() });
+          break;
+        case Opcode::Call: {
+          uint32_t callee = ins.wide();
+          std::vector<std::pair<Location, Location>> moves;
+          for (size_t i = 0; i < program.functions[callee].params.size(); i++) {
+            moves.push_back({ in(argumentRegs[i]), locations[ins.a + i] });
+          }
+          parallelMove(moves);
+          calls.push_back({ assembler.call(), callee });
+          assembler.move(locations[ins.a], in(RAX));
+          break;
+        }
+        case Opcode::Return:
+          assembler.move(in(RAX), locations[ins.a]);
+          emitEpilogue();
+          break;
+      }
+    }
+
+    offsets[end - begin] = assembler.position();
+    for (auto& jump : jumps) {
+      assembler.patch(jump.field, offsets[jump.target - begin]);
+    }
+  }
+};
+
+}  // namespace
+
+#endif
+
+
+JitProgram::~JitProgram() {
+#ifdef JIT_X86_64
+  if (code) {
+    munmap(code, mappedSize);
+  }
+#endif
+}
+
+bool JitProgram::compile(const BytecodeProgram& program, std::string& error) {
+#ifdef JIT_X86_64
+  for (auto& function : program.functions) {
+    if (function.params.size() > MaxArguments) {
+      error = function.name + " takes more than " + std::to_string(MaxArguments) + " arguments, which the JIT does not support";
+      return false;
+    }
+  }
+
+  // each function's code runs to the next entry
+  std::vector<uint32_t> starts;
+  for (auto& function : program.functions) {
+    starts.push_back(function.entry);
+  }
+  starts.push_back(program.code.size());
+  std::sort(starts.begin(), starts.end());
+
+  Assembler assembler;
+  int32_t limitOffset = stackLimitOffset();
+  std::vector<Relocation> calls, divisionTraps, stackTraps;
+  entries.clear();
+  params.clear();
+  for (uint32_t function = 0; function < program.functions.size(); function++) {
+    // functions start on 16-byte boundaries
+    while (assembler.position() % 16) {
+      assembler.byte(0xCC);
+    }
+    entries.push_back(assembler.position());
+    params.push_back(program.functions[function].params);
+
+    uint32_t begin = program.functions[function].entry;
+    uint32_t end = *std::upper_bound(starts.begin(), starts.end(), begin);
+    FunctionCompiler compiler(program, function, begin, end, assembler);
+    compiler.compile(limitOffset);
+    calls.insert(calls.end(), compiler.calls.begin(), compiler.calls.end());
+    divisionTraps.insert(divisionTraps.end(), compiler.divisionTraps.begin(), compiler.divisionTraps.end());
+    stackTraps.insert(stackTraps.end(), compiler.stackTraps.begin(), compiler.stackTraps.end());
+  }
+
+  // mov edi, kind; and rsp, -16; mov rax, trap; call rax
+  uint32_t trapStubs[2];
+  for (int kind : { DivisionByZero, StackOverflow }) {
+    trapStubs[kind - 1] = assembler.position();
+    assembler.byte(0xBF);
+    assembler.dword(kind);
+    assembler.op(true, { 0x83 }, 4, in(RSP));
+    assembler.byte(0xF0);
+    assembler.byte(0x48);
+    assembler.byte(0xB8);
+    assembler.qword(reinterpret_cast<uint64_t>(&trap));
+    assembler.op(false, { 0xFF }, 2, in(RAX));
+  }
+
+  for (auto& call : calls) {
+    assembler.patch(call.field, entries[call.target]);
+  }
+  for (auto& jump : divisionTraps) {
+    assembler.patch(jump.field, trapStubs[DivisionByZero - 1]);
+  }
+  for (auto& jump : stackTraps) {
+    assembler.patch(jump.field, trapStubs[StackOverflow - 1]);
+  }
+
+  if (code) {
+    munmap(code, mappedSize);
+    code = nullptr;
+  }
+  size = assembler.bytes.size();
+  long page = sysconf(_SC_PAGESIZE);
+  mappedSize = (size + page - 1) / page * page;
+  void *memory = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    error = "can't map memory for JIT code";
+    return false;
+  }
+  std::memcpy(memory, assembler.bytes.data(), size);
+  if (mprotect(memory, mappedSize, PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory, mappedSize);
+    error = "can't make JIT code executable";
+    return false;
+  }
+  code = static_cast<uint8_t*>(memory);
+  return true;
+#else
+  (void)program;
+  error = "the JIT only runs on x86-64 Linux";
+  return false;
+#endif
+}
+
+bool JitProgram::call(uint32_t function, const std::vector<int64_t>& args, int64_t& result, std::string& error) const {
+#ifdef JIT_X86_64
+  if (args.size() != params[function].size()) {
+    error = "function takes " + std::to_string(params[function].size()) + " arguments";
+    return false;
+  }
+
+  TrapContext context;
+  TrapContext *outerTrap = activeTrap;
+  uintptr_t outerLimit = stackLimit;
+  activeTrap = &context;
+  stackLimit = threadStackLimit();
+
+  int kind = setjmp(context.buffer);
+  if (kind == 0) {
+    void *native = entry(function);
+    const int64_t *a = args.data();
+    switch (args.size()) {
+      case 0: result = reinterpret_cast<int64_t(*)()>(native)(); break;
+      case 1: result = reinterpret_cast<int64_t(*)(int64_t)>(native)(a[0]); break;
+      case 2: result = reinterpret_cast<int64_t(*)(int64_t, int64_t)>(native)(a[0], a[1]); break;
+      case 3: result = reinterpret_cast<int64_t(*)(int64_t, int64_t, int64_t)>(native)(a[0], a[1], a[2]); break;
+      case 4:
+        result = reinterpret_cast<int64_t(*)(int64_t, int64_t, int64_t, int64_t)>(native)(a[0], a[1], a[2], a[3]);
+        break;
+      case 5:
+        result = reinterpret_cast<int64_t(*)(int64_t, int64_t, int64_t, int64_t, int64_t)>(native)(
+          a[0], a[1], a[2], a[3], a[4]);
+        break;
+      default:
+        result = reinterpret_cast<int64_t(*)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t)>(native)(
+          a[0], a[1], a[2], a[3], a[4], a[5]);
+        break;
+    }
+  }
+  else {
+    error = (kind == DivisionByZero) ? "division by zero" : "stack overflow";
+  }
+
+  activeTrap = outerTrap;
+  stackLimit = outerLimit;
+  return kind == 0;
+#else
+  (void)function;
+  (void)args;
+  (void)result;
+  error = "the JIT only runs on x86-64 Linux";
+  return false;
+#endif
+}
@@ -0,0 +1,45 @@
+#ifndef JIT_H_
+#define JIT_H_
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "Bytecode.h"
+
+
+// Native x86-64 code for every function of a BytecodeProgram. Bytecode
+// registers are assigned to machine registers by linear scan; values live
+// across a call get callee-saved registers or stack slots. Functions
+// follow the System V calling convention and call each other directly.
+class JitProgram {
+ public:
+  JitProgram() {}
+  ~JitProgram();
+  JitProgram(const JitProgram&) = delete;
+  JitProgram& operator=(const JitProgram&) = delete;
+
+  // false with a message in error on anything but x86-64 Linux, or when a
+  // function takes more than six parameters
+  bool compile(const BytecodeProgram& program, std::string& error);
+
+  // native code of function, callable as int64_t f(int64_t, ...) with the
+  // arguments encoded as for the VM. A division by zero or a stack overflow
+  // inside aborts the process unless the function is run through call.
+  void* entry(uint32_t function) const { return code + entries[function]; }
+
+  // false with a message in error on a runtime error, as VirtualMachine::call
+  bool call(uint32_t function, const std::vector<int64_t>& args, int64_t& result, std::string& error) const;
+
+  size_t codeSize() const { return size; }
+
+ private:
+  uint8_t *code = nullptr;
+  size_t size = 0;
+  size_t mappedSize = 0;
+  std::vector<uint32_t> entries;
+  std::vector<std::vector<PrimitiveKind>> params;
+};
+
+#endif
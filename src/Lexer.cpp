@@ -0,0 +1,257 @@
+#include <vector>
+#include <string_view>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "Lexer.h"
+
+
+const char* tokenSpelling(TokenKind kind) {
+  switch (kind) {
+    case TokenKind::Fn: return "fn";
+    case TokenKind::LParen: return "(";
+    case TokenKind::RParen: return ")";
+    case TokenKind::Comma: return ",";
+    case TokenKind::Colon: return ":";
+    case TokenKind::Int: return "int";
+    case TokenKind::Float: return "float";
+    case TokenKind::Char: return "char";
+    case TokenKind::Bool: return "bool";
+    case TokenKind::LBrace: return "{";
+    case TokenKind::RBrace: return "}";
+    case TokenKind::If: return "if";
+    case TokenKind::Else: return "else";
+    case TokenKind::Let: return "let";
+    case TokenKind::Assign: return "=";
+    case TokenKind::Semicolon: return ";";
+    case TokenKind::Return: return "return";
+    case TokenKind::Minus: return "-";
+    case TokenKind::Not: return "!";
+    case TokenKind::Star: return "*";
+    case TokenKind::Slash: return "/";
+    case TokenKind::Plus: return "+";
+    case TokenKind::EqualEqual: return "==";
+    default: return nullptr;
+  }
+}
+
+
+namespace {
+
+bool isWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+bool isLetter(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+bool isHexDigit(char c) {
+  return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+class Scanner {
+ public:
+  Scanner(std::string_view source) : begin(source.data()), p(source.data()), end(source.data() + source.size()), lineStart(source.data()) {}
+
+  const char *begin, *p, *end;
+  uint32_t line = 1;
+  const char *lineStart;
+
+  // skips [ \t\n\r]* and keeps line tracking in sync
+  void skipWhitespace() {
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i carriage = _mm_set1_epi8('\r');
+    while (end - p >= 16) {
+      __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+      __m128i newlines = _mm_cmpeq_epi8(chunk, newline);
+      __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+                                _mm_or_si128(newlines, _mm_cmpeq_epi8(chunk, carriage)));
+      unsigned nonWs = ~_mm_movemask_epi8(ws) & 0xFFFF;
+      unsigned skipped = (nonWs == 0) ? 16 : __builtin_ctz(nonWs);
+      unsigned nl = _mm_movemask_epi8(newlines) & ((1u << skipped) - 1);
+      if (nl != 0) {
+        line += __builtin_popcount(nl);
+        lineStart = p + (31 - __builtin_clz(nl)) + 1;
+      }
+      p += skipped;
+      if (nonWs != 0) {
+        return;
+      }
+    }
+#endif
+    while (p < end && isWhitespace(*p)) {
+      if (*p == '\n') {
+        line++;
+        lineStart = p + 1;
+      }
+      p++;
+    }
+  }
+
+  // moves p just past the next '\n'. False when there is none, as the
+  // grammar's SL_COMMENT needs one to end a comment.
+  bool skipLine() {
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+      __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+      unsigned nl = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+      if (nl != 0) {
+        p += __builtin_ctz(nl) + 1;
+        line++;
+        lineStart = p;
+        return true;
+      }
+      p += 16;
+    }
+#endif
+    while (p < end) {
+      if (*p++ == '\n') {
+        line++;
+        lineStart = p;
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+TokenKind keywordOrIdentifier(std::string_view word) {
+  switch (word.size()) {
+    case 2:
+      if (word == "fn") return TokenKind::Fn;
+      if (word == "if") return TokenKind::If;
+      break;
+    case 3:
+      if (word == "int") return TokenKind::Int;
+      if (word == "let") return TokenKind::Let;
+      break;
+    case 4:
+      if (word == "char") return TokenKind::Char;
+      if (word == "bool") return TokenKind::Bool;
+      if (word == "else") return TokenKind::Else;
+      if (word == "true") return TokenKind::BoolLiteral;
+      break;
+    case 5:
+      if (word == "float") return TokenKind::Float;
+      if (word == "false") return TokenKind::BoolLiteral;
+      break;
+    case 6:
+      if (word == "return") return TokenKind::Return;
+      break;
+  }
+  return TokenKind::Identifier;
+}
+
+}  // namespace
+
+
+bool lexSource(std::string_view source, Interner& names, std::vector<LexToken>& tokens) {
+  Scanner s(source);
+  tokens.clear();
+  // tokens average well over 3 bytes of source
+  tokens.reserve(source.size() / 3 + 1);
+
+  while (true) {
+    s.skipWhitespace();
+    if (s.p == s.end) {
+      break;
+    }
+    const char *start = s.p;
+    char c = *s.p;
+    TokenKind kind;
+
+    if (c == '/' && s.end - s.p >= 2 && s.p[1] == '/') {
+      if (!s.skipLine()) {
+        return false;
+      }
+      continue;
+    }
+
+    if (isLetter(c)) {
+      do {
+        s.p++;
+      } while (s.p < s.end && (isLetter(*s.p) || isDigit(*s.p)));
+      kind = keywordOrIdentifier(std::string_view(start, s.p - start));
+    }
+    else if (c >= '1' && c <= '9') {
+      do {
+        s.p++;
+      } while (s.p < s.end && isDigit(*s.p));
+      kind = TokenKind::IntegerLiteral;
+    }
+    else if (c == '0') {
+      // only hexadecimal literals may start with 0
+      if (s.end - s.p < 3 || s.p[1] != 'x' || !isHexDigit(s.p[2])) {
+        return false;
+      }
+      s.p += 2;
+      while (s.p < s.end && isHexDigit(*s.p)) {
+        s.p++;
+      }
+      kind = TokenKind::IntegerLiteral;
+    }
+    else if (c == '\'') {
+      if (s.end - s.p < 3 || s.p[2] != '\'' || s.p[1] == '\'' || s.p[1] == '\\' ||
+          s.p[1] == '\r' || s.p[1] == '\n' || static_cast<unsigned char>(s.p[1]) >= 0x80) {
+        return false;
+      }
+      s.p += 3;
+      kind = TokenKind::CharacterLiteral;
+    }
+    else {
+      s.p++;
+      switch (c) {
+        case '(': kind = TokenKind::LParen; break;
+        case ')': kind = TokenKind::RParen; break;
+        case ',': kind = TokenKind::Comma; break;
+        case ':': kind = TokenKind::Colon; break;
+        case '{': kind = TokenKind::LBrace; break;
+        case '}': kind = TokenKind::RBrace; break;
+        case ';': kind = TokenKind::Semicolon; break;
+        case '-': kind = TokenKind::Minus; break;
+        case '!': kind = TokenKind::Not; break;
+        case '*': kind = TokenKind::Star; break;
+        case '/': kind = TokenKind::Slash; break;
+        case '+': kind = TokenKind::Plus; break;
+        case '=':
+          if (s.p < s.end && *s.p == '=') {
+            s.p++;
+            kind = TokenKind::EqualEqual;
+          }
+          else {
+            kind = TokenKind::Assign;
+          }
+          break;
+        default:
+          return false;
+      }
+    }
+
+    LexToken token;
+    token.kind = kind;
+    token.offset = start - s.begin;
+    token.length = s.p - start;
+    token.line = s.line;
+    token.column = start - s.lineStart;
+    token.symbol = (kind == TokenKind::Identifier) ? names.intern(std::string_view(start, token.length)) : NoSymbol;
+    tokens.push_back(token);
+  }
+
+  LexToken eof;
+  eof.kind = TokenKind::Eof;
+  eof.offset = s.p - s.begin;
+  eof.length = 0;
+  eof.line = s.line;
+  eof.column = s.p - s.lineStart;
+  eof.symbol = NoSymbol;
+  tokens.push_back(eof);
+  return true;
+}
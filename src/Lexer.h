@@ -0,0 +1,69 @@
+#ifndef LEXER_H_
+#define LEXER_H_
+
+#include <vector>
+#include <string_view>
+#include <cstdint>
+
+#include "Interner.h"
+
+
+// Token set of Tmplang.g4. Keywords and punctuation follow their order of
+// appearance in the grammar.
+enum class TokenKind : uint8_t {
+  Fn,
+  LParen,
+  RParen,
+  Comma,
+  Colon,
+  Int,
+  Float,
+  Char,
+  Bool,
+  LBrace,
+  RBrace,
+  If,
+  Else,
+  Let,
+  Assign,
+  Semicolon,
+  Return,
+  Minus,
+  Not,
+  Star,
+  Slash,
+  Plus,
+  EqualEqual,
+
+  IntegerLiteral,
+  CharacterLiteral,
+  BoolLiteral,
+  Identifier,
+  Eof,
+};
+
+// spelling of keyword and punctuation tokens as written in the grammar
+const char* tokenSpelling(TokenKind kind);
+
+struct LexToken {
+  TokenKind kind;
+  // byte range in the source
+  uint32_t offset;
+  uint32_t length;
+  // 1-based line and 0-based column, as ANTLR reports them
+  uint32_t line;
+  uint32_t column;
+  // interned name of Identifier tokens, NoSymbol otherwise
+  SymbolId symbol;
+};
+
+// Hand-written lexer for the ASCII token set of the grammar. Whitespace and
+// '//' comments are skipped 16 bytes at a time with SSE2 where available, and
+// identifiers are interned as they are scanned. Returns false at the first
+// byte that is not a valid token start (including any non-ASCII input) and
+// at a comment with no '\n' after it, which the grammar rejects too, so
+// the caller can fall back to the generated ANTLR lexer for diagnostics.
+// tokens always ends with an Eof token on success.
+bool lexSource(std::string_view source, Interner& names, std::vector<LexToken>& tokens);
+
+#endif
@@ -0,0 +1,453 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <string_view>
+#include <algorithm>
+#include <chrono>
+#include <charconv>
+#include <cstdint>
+
+#include "antlr4-runtime.h"
+#include "TmplangLexer.h"
+#include "TmplangParser.h"
+
+#include "AST.h"
+#include "Interner.h"
+#include "Lexer.h"
+#include "Lowering.h"
+
+using namespace antlr4;
+
+
+namespace {
+
+// Identifier of every ID token, interned once right after lexing.
+class IdentifierTable {
+ public:
+  // tokens must already be filled
+  IdentifierTable(CommonTokenStream& tokens, Interner& names) {
+    for (auto *token : tokens.getTokens()) {
+      symbols.push_back(token->getType() == TmplangParser::ID ? names.intern(token->getText()) : NoSymbol);
+    }
+  }
+
+  // from the hand-written lexer, which interns while scanning
+  explicit IdentifierTable(const std::vector<LexToken>& tokens) {
+    symbols.reserve(tokens.size());
+    for (auto& token : tokens) {
+      symbols.push_back(token.symbol);
+    }
+  }
+
+  SymbolId operator()(TmplangParser::IdentifierContext *ctx) const {
+    return symbols[ctx->ID()->getSymbol()->getTokenIndex()];
+  }
+
+ private:
+  std::vector<SymbolId> symbols;
+};
+
+
+// Feeds the tokens of lexSource to the ANTLR parser, so the generated
+// lexer and its char stream are skipped entirely on valid input.
+class FastTokenSource : public TokenSource {
+ public:
+  FastTokenSource(std::string_view _source, const std::vector<LexToken>& _tokens)
+    : source(_source), tokens(_tokens) {}
+
+  // token types are only known from the parser's vocabulary
+  void mapTokenTypes(const dfa::Vocabulary& vocabulary) {
+    for (size_t type = 1; type <= vocabulary.getMaxTokenType(); type++) {
+      std::string literal = vocabulary.getLiteralName(type);
+      for (int kind = 0; kind < static_cast<int>(TokenKind::IntegerLiteral); kind++) {
+        if (literal == std::string("'") + tokenSpelling(static_cast<TokenKind>(kind)) + "'") {
+          types[kind] = type;
+        }
+      }
+    }
+    types[static_cast<int>(TokenKind::IntegerLiteral)] = TmplangParser::IntegerLiteral;
+    types[static_cast<int>(TokenKind::CharacterLiteral)] = TmplangParser::CharacterLiteral;
+    types[static_cast<int>(TokenKind::BoolLiteral)] = TmplangParser::BoolLiteral;
+    types[static_cast<int>(TokenKind::Identifier)] = TmplangParser::ID;
+    types[static_cast<int>(TokenKind::Eof)] = Token::EOF;
+  }
+
+  std::unique_ptr<Token> nextToken() override {
+    const LexToken& lexToken = tokens[std::min(next, tokens.size() - 1)];
+    next++;
+    auto token = std::make_unique<CommonToken>(types[static_cast<int>(lexToken.kind)]);
+    if (lexToken.kind == TokenKind::Eof) {
+      token->setText("<EOF>");
+    }
+    else {
+      token->setText(std::string(source.substr(lexToken.offset, lexToken.length)));
+    }
+    token->setLine(lexToken.line);
+    token->setCharPositionInLine(lexToken.column);
+    token->setStartIndex(lexToken.offset);
+    token->setStopIndex(lexToken.offset + lexToken.length - 1);
+    line = lexToken.line;
+    column = lexToken.column + lexToken.length;
+    return token;
+  }
+
+  size_t getLine() const override { return line; }
+  size_t getCharPositionInLine() override { return column; }
+  CharStream* getInputStream() override { return nullptr; }
+  std::string getSourceName() override { return IntStream::UNKNOWN_SOURCE_NAME; }
+  Ref<TokenFactory<CommonToken>> getTokenFactory() override { return CommonTokenFactory::DEFAULT; }
+
+ private:
+  std::string_view source;
+  const std::vector<LexToken>& tokens;
+  size_t types[static_cast<int>(TokenKind::Eof) + 1] = {};
+  size_t next = 0;
+  size_t line = 1;
+  size_t column = 0;
+};
+
+
+PrimitiveKind parsePrimitive(TmplangParser::TypeContext *ctx) {
+  std::string name = ctx->getText();
+  if (name == "float") return PrimitiveKind::Float;
+  if (name == "char") return PrimitiveKind::Char;
+  if (name == "bool") return PrimitiveKind::Bool;
+  return PrimitiveKind::Int;
+}
+
+// false when text does not fit in a C int. A larger literal would be a
+// long in the emitted C, which the folder and the VM can't follow. A
+// negative literal is a - applied to one, so INT_MIN is written -2147483647 - 1.
+bool parseIntegerLiteral(const std::string& text, int64_t& value) {
+  const char *begin = text.data(), *end = text.data() + text.size();
+  int base = 10;
+  if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+    begin += 2;
+    base = 16;
+  }
+  auto result = std::from_chars(begin, end, value, base);
+  return result.ec == std::errc() && result.ptr == end && value <= INT32_MAX;
+}
+
+
+class Lowering {
+ public:
+  Lowering(Ast& _ast, const IdentifierTable& _identifiers) : ast(_ast), identifiers(_identifiers) {}
+
+  Ast& ast;
+  const IdentifierTable& identifiers;
+  // set when a literal could not be lowered
+  bool failed = false;
+
+  void lowerFile(TmplangParser::FileContext *ctx) {
+    ast.root = ast.addNode(NodeKind::File);
+
+    std::vector<NodeId> functions;
+    for (auto *func : ctx->function()) {
+      functions.push_back(lowerFunction(func));
+    }
+    ast.setList(ast.root, functions);
+  }
+
+  NodeId lowerFunction(TmplangParser::FunctionContext *ctx) {
+    std::vector<NodeId> params;
+    if (ctx->functionParams() != nullptr) {
+      for (auto *decl : ctx->functionParams()->functionParamDecl()) {
+        NodeId param = ast.addNode(NodeKind::Param);
+        ast[param].name = identifiers(decl->identifier());
+        ast[param].hasDeclType = true;
+        ast[param].declType = parsePrimitive(decl->type());
+        params.push_back(param);
+      }
+    }
+    NodeId body = lowerBlock(ctx->blockStatement());
+
+    NodeId id = ast.addNode(NodeKind::Function);
+    ast[id].name = identifiers(ctx->identifier());
+    if (ctx->functionReturnTypeDecl() != nullptr) {
+      ast[id].hasDeclType = true;
+      ast[id].declType = parsePrimitive(ctx->functionReturnTypeDecl()->type());
+    }
+    ast[id].operands[0] = body;
+    ast.setList(id, params);
+    return id;
+  }
+
+  NodeId lowerBlock(TmplangParser::BlockStatementContext *ctx) {
+    std::vector<NodeId> statements;
+    for (auto *stmt : ctx->statement()) {
+      statements.push_back(lowerStatement(stmt));
+    }
+    NodeId id = ast.addNode(NodeKind::Block);
+    ast.setList(id, statements);
+    return id;
+  }
+
+  NodeId lowerIf(TmplangParser::IfStatementContext *ctx) {
+    NodeId cond = lowerExpr(ctx->expr());
+    NodeId thenBlock = lowerBlock(ctx->blockStatement()[0]);
+    NodeId elseBranch = NoNode;
+    if (ctx->blockStatement().size() > 1) {
+      elseBranch = lowerBlock(ctx->blockStatement()[1]);
+    }
+    else if (ctx->ifStatement() != nullptr) {
+      elseBranch = lowerIf(ctx->ifStatement());
+    }
+
+    NodeId id = ast.addNode(NodeKind::If);
+    ast[id].operands[0] = cond;
+    ast[id].operands[1] = thenBlock;
+    ast[id].operands[2] = elseBranch;
+    return id;
+  }
+
+  NodeId lowerStatement(TmplangParser::StatementContext *ctx) {
+    if (ctx->ifStatement() != nullptr) {
+      return lowerIf(ctx->ifStatement());
+    }
+    if (ctx->blockStatement() != nullptr) {
+      return lowerBlock(ctx->blockStatement());
+    }
+    if (ctx->varDeclStatement() != nullptr) {
+      auto *decl = ctx->varDeclStatement();
+      NodeId init = (decl->expr() != nullptr) ? lowerExpr(decl->expr()) : NoNode;
+      NodeId id = ast.addNode(NodeKind::VarDecl);
+      ast[id].name = identifiers(decl->identifier());
+      if (decl->type() != nullptr) {
+        ast[id].hasDeclType = true;
+        ast[id].declType = parsePrimitive(decl->type());
+      }
+      ast[id].operands[0] = init;
+      return id;
+    }
+    if (ctx->returnStatement() != nullptr) {
+      auto *ret = ctx->returnStatement();
+      NodeId value = (ret->expr() != nullptr) ? lowerExpr(ret->expr()) : NoNode;
+      NodeId id = ast.addNode(NodeKind::Return);
+      ast[id].operands[0] = value;
+      return id;
+    }
+    if (ctx->assignStatement() != nullptr) {
+      auto *assign = ctx->assignStatement();
+      NodeId value = lowerExpr(assign->expr());
+      NodeId id = ast.addNode(NodeKind::Assign);
+      ast[id].name = identifiers(assign->identifier());
+      ast[id].operands[0] = value;
+      return id;
+    }
+    NodeId expr = lowerExpr(ctx->normalStatement()->expr());
+    NodeId id = ast.addNode(NodeKind::ExprStmt);
+    ast[id].operands[0] = expr;
+    return id;
+  }
+
+  NodeId lowerUnary(NodeKind kind, TmplangParser::ExprContext *operand) {
+    NodeId inner = lowerExpr(operand);
+    NodeId id = ast.addNode(kind);
+    ast[id].operands[0] = inner;
+    return id;
+  }
+
+  NodeId lowerBinary(NodeKind kind, TmplangParser::ExprContext *lhs, TmplangParser::ExprContext *rhs) {
+    NodeId left = lowerExpr(lhs);
+    NodeId right = lowerExpr(rhs);
+    NodeId id = ast.addNode(kind);
+    ast[id].operands[0] = left;
+    ast[id].operands[1] = right;
+    return id;
+  }
+
+  // the operator token of a binary expr sits between its two operands
+  static std::string operatorOf(ParserRuleContext *ctx) {
+    return ctx->children[1]->getText();
+  }
+
+  NodeId lowerExpr(TmplangParser::ExprContext *ctx) {
+    if (auto *call = dynamic_cast<TmplangParser::FunctionCallExprContext*>(ctx)) {
+      NodeId callee = lowerExpr(call->expr());
+      std::vector<NodeId> args;
+      if (call->exprList() != nullptr) {
+        for (auto *arg : call->exprList()->expr()) {
+          args.push_back(lowerExpr(arg));
+        }
+      }
+      NodeId id = ast.addNode(NodeKind::Call);
+      ast[id].operands[0] = callee;
+      ast.setList(id, args);
+      return id;
+    }
+    if (auto *negate = dynamic_cast<TmplangParser::NegateExprContext*>(ctx)) {
+      return lowerUnary(NodeKind::Negate, negate->expr());
+    }
+    if (auto *notExpr = dynamic_cast<TmplangParser::NotExprContext*>(ctx)) {
+      return lowerUnary(NodeKind::Not, notExpr->expr());
+    }
+    if (auto *paren = dynamic_cast<TmplangParser::ParenExprContext*>(ctx)) {
+      return lowerUnary(NodeKind::Paren, paren->expr());
+    }
+    if (auto *mulDiv = dynamic_cast<TmplangParser::MulDivExprContext*>(ctx)) {
+      NodeKind kind = (operatorOf(mulDiv) == "*") ? NodeKind::Mul : NodeKind::Div;
+      return lowerBinary(kind, mulDiv->expr()[0], mulDiv->expr()[1]);
+    }
+    if (auto *plusMinus = dynamic_cast<TmplangParser::PlusMinusExprContext*>(ctx)) {
+      NodeKind kind = (operatorOf(plusMinus) == "+") ? NodeKind::Add : NodeKind::Sub;
+      return lowerBinary(kind, plusMinus->expr()[0], plusMinus->expr()[1]);
+    }
+    if (auto *equal = dynamic_cast<TmplangParser::EqualExprContext*>(ctx)) {
+      return lowerBinary(NodeKind::Equal, equal->expr()[0], equal->expr()[1]);
+    }
+    if (auto *varRef = dynamic_cast<TmplangParser::VarRefExprContext*>(ctx)) {
+      NodeId id = ast.addNode(NodeKind::VarRef);
+      ast[id].name = identifiers(varRef->identifier());
+      return id;
+    }
+
+    auto *literal = dynamic_cast<TmplangParser::LiteralExprContext*>(ctx)->literal();
+    if (literal->IntegerLiteral() != nullptr) {
+      NodeId id = ast.addNode(NodeKind::IntLiteral);
+      if (!parseIntegerLiteral(literal->getText(), ast[id].value)) {
+        std::cerr << "integer literal out of range: " << literal->getText() << "!!!\n";
+        failed = true;
+      }
+      return id;
+    }
+    if (literal->BoolLiteral() != nullptr) {
+      NodeId id = ast.addNode(NodeKind::BoolLiteral);
+      ast[id].value = (literal->getText() == "true");
+      return id;
+    }
+    if (literal->CharacterLiteral() == nullptr) {
+      std::cerr << "unparsable literal!!\n";
+    }
+    // 'c': the character sits between the quotes
+    NodeId id = ast.addNode(NodeKind::CharLiteral);
+    ast[id].value = static_cast<unsigned char>(literal->getText()[1]);
+    return id;
+  }
+};
+
+
+
+// Runs the parser in the requested prediction mode over whatever token
+// source it was built on.
+TmplangParser::FileContext* parseFile(TmplangParser& parser, ParseMode mode, ParseStats *stats) {
+  auto *interpreter = parser.getInterpreter<atn::ParserATNSimulator>();
+
+  if (mode == ParseMode::LL) {
+    interpreter->setPredictionMode(atn::PredictionMode::LL);
+    return parser.file();
+  }
+  if (mode == ParseMode::SLL) {
+    interpreter->setPredictionMode(atn::PredictionMode::SLL);
+    return parser.file();
+  }
+
+  // SLL is exact for nearly every input; a syntax error or a decision
+  // that really needs full context makes it bail out, and only then
+  // the file is parsed again with full LL and normal error reporting.
+  interpreter->setPredictionMode(atn::PredictionMode::SLL);
+  parser.removeErrorListeners();
+  parser.setErrorHandler(std::make_shared<BailErrorStrategy>());
+  try {
+    return parser.file();
+  }
+  catch (ParseCancellationException&) {
+    if (stats != nullptr) {
+      stats->fellBack = true;
+    }
+    parser.reset();
+    parser.addErrorListener(&ConsoleErrorListener::INSTANCE);
+    parser.setErrorHandler(std::make_shared<DefaultErrorStrategy>());
+    interpreter->setPredictionMode(atn::PredictionMode::LL);
+    return parser.file();
+  }
+}
+
+// milliseconds since start, which is updated to now
+double lap(std::chrono::steady_clock::time_point& start) {
+  auto now = std::chrono::steady_clock::now();
+  double millis = std::chrono::duration<double, std::milli>(now - start).count();
+  start = now;
+  return millis;
+}
+
+// Counts the errors a recognizer reports; ConsoleErrorListener prints them.
+class ErrorCounter : public BaseErrorListener {
+ public:
+  size_t errors = 0;
+
+  void syntaxError(Recognizer*, Token*, size_t, size_t, const std::string&, std::exception_ptr) override {
+    errors++;
+  }
+};
+
+// Lowers a parsed file into ast, which is left without a root when the
+// source had syntax errors or a literal could not be lowered.
+void lowerParsed(Ast& ast, const IdentifierTable& identifiers, TmplangParser::FileContext *file, size_t syntaxErrors) {
+  if (syntaxErrors != 0) {
+    return;
+  }
+  Lowering lowering(ast, identifiers);
+  lowering.lowerFile(file);
+  if (lowering.failed) {
+    ast = Ast();
+  }
+}
+
+}  // namespace
+
+
+Ast parseSource(std::string_view source, Interner& names, const ParseOptions& options, ParseStats *stats) {
+  Ast ast;
+  // the clock is only read for stats
+  std::chrono::steady_clock::time_point start;
+  if (stats != nullptr) {
+    start = std::chrono::steady_clock::now();
+  }
+
+  std::vector<LexToken> lexTokens;
+  if (options.fastLexer && lexSource(source, names, lexTokens)) {
+    if (stats != nullptr) {
+      stats->lexMillis += lap(start);
+      stats->tokens = lexTokens.size();
+    }
+    FastTokenSource tokenSource(source, lexTokens);
+    CommonTokenStream tokens(&tokenSource);
+    TmplangParser parser(&tokens);
+    tokenSource.mapTokenTypes(parser.getVocabulary());
+
+    IdentifierTable identifiers(lexTokens);
+    auto *file = parseFile(parser, options.mode, stats);
+    lowerParsed(ast, identifiers, file, parser.getNumberOfSyntaxErrors());
+    if (stats != nullptr) {
+      stats->parseMillis += lap(start);
+    }
+    return ast;
+  }
+
+  // the generated lexer reports what the hand-written one rejected
+  if (options.fastLexer && stats != nullptr) {
+    stats->lexerFellBack = true;
+  }
+  ANTLRInputStream stream(source.data(), source.size());
+  TmplangLexer lexer(&stream);
+  ErrorCounter lexerErrors;
+  lexer.addErrorListener(&lexerErrors);
+  CommonTokenStream tokens(&lexer);
+  tokens.fill();
+
+  IdentifierTable identifiers(tokens, names);
+  if (stats != nullptr) {
+    stats->lexMillis += lap(start);
+    stats->tokens = tokens.size();
+  }
+
+  TmplangParser parser(&tokens);
+  auto *file = parseFile(parser, options.mode, stats);
+  lowerParsed(ast, identifiers, file, lexerErrors.errors + parser.getNumberOfSyntaxErrors());
+  if (stats != nullptr) {
+    stats->parseMillis += lap(start);
+  }
+  return ast;
+}
@@ -0,0 +1,43 @@
+#ifndef LOWERING_H_
+#define LOWERING_H_
+
+#include <string_view>
+#include <cstddef>
+
+#include "AST.h"
+#include "Interner.h"
+
+
+enum class ParseMode {
+  // full ALL(*) prediction
+  LL,
+  // SLL prediction only; may report errors on inputs that need full LL
+  SLL,
+  // SLL with a bail-out error strategy, re-parsing with full LL only if it fails
+  TwoStage,
+};
+
+struct ParseOptions {
+  ParseMode mode = ParseMode::TwoStage;
+  // lex with the hand-written lexer (Lexer.h) instead of the generated one
+  bool fastLexer = true;
+};
+
+struct ParseStats {
+  // set when TwoStage had to re-parse with full LL
+  bool fellBack = false;
+  // set when the fast lexer rejected the input and the ANTLR lexer was used
+  bool lexerFellBack = false;
+  // wall time spent lexing, and parsing and lowering
+  double lexMillis = 0;
+  double parseMillis = 0;
+  size_t tokens = 0;
+};
+
+// Lexes and parses a whole source and lowers the parse tree into an Ast.
+// Identifiers are interned into names once, while lexing. The parse tree
+// and token stream are released on return; source must outlive the call only.
+// On a syntax error the errors are printed and the Ast is left without a root.
+Ast parseSource(std::string_view source, Interner& names, const ParseOptions& options = ParseOptions(), ParseStats *stats = nullptr);
+
+#endif
@@ -0,0 +1,92 @@
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include <sys/resource.h>
+
+#include "PassStats.h"
+
+
+void PassStats::addTime(const std::string& name, double millis) {
+  for (auto& phase : phases) {
+    if (phase.name == name) {
+      phase.millis += millis;
+      return;
+    }
+  }
+  phases.push_back({ name, millis });
+}
+
+void PassStats::count(const std::string& name, uint64_t value) {
+  for (auto& counter : counters) {
+    if (counter.name == name) {
+      counter.value += value;
+      return;
+    }
+  }
+  counters.push_back({ name, value });
+}
+
+void PassStats::merge(const PassStats& other) {
+  for (auto& phase : other.phases) {
+    addTime(phase.name, phase.millis);
+  }
+  for (auto& counter : other.counters) {
+    count(counter.name, counter.value);
+  }
+}
+
+std::string PassStats::report(bool json) const {
+  double total = 0;
+  for (auto& phase : phases) {
+    total += phase.millis;
+  }
+  size_t peak = peakResidentBytes();
+
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(3);
+  if (json) {
+    // names are plain words, so they need no escaping
+    oss << "{\"phases\": {";
+    for (size_t i = 0; i < phases.size(); i++) {
+      oss << (i == 0 ? "" : ", ") << "\"" << phases[i].name << "\": " << phases[i].millis;
+    }
+    oss << "}, \"total_ms\": " << total << ", \"counters\": {";
+    for (size_t i = 0; i < counters.size(); i++) {
+      oss << (i == 0 ? "" : ", ") << "\"" << counters[i].name << "\": " << counters[i].value;
+    }
+    oss << "}, \"peak_rss_bytes\": " << peak << "}\n";
+    return oss.str();
+  }
+
+  size_t width = 13;
+  for (auto& phase : phases) {
+    width = std::max(width, phase.name.size());
+  }
+  for (auto& counter : counters) {
+    width = std::max(width, counter.name.size());
+  }
+  oss << std::left << std::setw(width + 2) << "phase" << std::right << std::setw(12) << "ms" << std::setw(8) << "%" << "\n";
+  for (auto& phase : phases) {
+    oss << std::left << std::setw(width + 2) << phase.name << std::right << std::setw(12) << phase.millis
+        << std::setprecision(1) << std::setw(8) << ((total > 0) ? 100 * phase.millis / total : 0.0)
+        << std::setprecision(3) << "\n";
+  }
+  oss << std::left << std::setw(width + 2) << "total" << std::right << std::setw(12) << total << "\n\n";
+  for (auto& counter : counters) {
+    oss << std::left << std::setw(width + 2) << counter.name << std::right << std::setw(12) << counter.value << "\n";
+  }
+  oss << std::left << std::setw(width + 2) << "peak RSS (KB)" << std::right << std::setw(12) << peak / 1024 << "\n";
+  return oss.str();
+}
+
+size_t peakResidentBytes() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  // kilobytes on Linux
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+}
@@ -0,0 +1,62 @@
+#ifndef PASS_STATS_H_
+#define PASS_STATS_H_
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+
+// Wall time of each compilation phase and the counters sizing its work,
+// in the order they were first recorded. Recording the same phase or
+// counter again adds to it, so the stats of several files can be merged.
+struct PassStats {
+  struct Phase {
+    std::string name;
+    double millis;
+  };
+  struct Counter {
+    std::string name;
+    uint64_t value;
+  };
+
+  std::vector<Phase> phases;
+  std::vector<Counter> counters;
+
+  void addTime(const std::string& name, double millis);
+  void count(const std::string& name, uint64_t value);
+  void merge(const PassStats& other);
+
+  // a table, or one JSON object when json is set, with the peak RSS of
+  // the process
+  std::string report(bool json) const;
+};
+
+// Adds the time until its destruction to a phase of stats. Does nothing,
+// not even read the clock, when stats is null.
+class PhaseTimer {
+ public:
+  PhaseTimer(PassStats *_stats, const char *_name) : stats(_stats), name(_name) {
+    if (stats != nullptr) {
+      start = std::chrono::steady_clock::now();
+    }
+  }
+  ~PhaseTimer() {
+    if (stats != nullptr) {
+      stats->addTime(name, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+  }
+  PhaseTimer(const PhaseTimer&) = delete;
+  PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+ private:
+  PassStats *stats;
+  const char *name;
+  std::chrono::steady_clock::time_point start;
+};
+
+// largest resident set of the process so far, 0 where it is unknown
+size_t peakResidentBytes();
+
+#endif
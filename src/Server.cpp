@@ -0,0 +1,292 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <set>
+#include <thread>
+#include <chrono>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/inotify.h>
+
+#include "SourceBuffer.h"
+#include "Server.h"
+
+
+namespace {
+
+// buffered reads of header lines and payloads from a descriptor
+class FdReader {
+ public:
+  explicit FdReader(int _fd) : fd(_fd) {}
+
+  bool readLine(std::string& line) {
+    while (true) {
+      size_t newline = buffer.find('\n', position);
+      if (newline != std::string::npos) {
+        line.assign(buffer, position, newline - position);
+        position = newline + 1;
+        return true;
+      }
+      if (!fill()) {
+        return false;
+      }
+    }
+  }
+
+  bool readBytes(size_t count, std::string& bytes) {
+    while (buffer.size() - position < count) {
+      if (!fill()) {
+        return false;
+      }
+    }
+    bytes.assign(buffer, position, count);
+    position += count;
+    return true;
+  }
+
+ private:
+  int fd;
+  std::string buffer;
+  size_t position = 0;
+
+  bool fill() {
+    buffer.erase(0, position);
+    position = 0;
+    char chunk[64 * 1024];
+    while (true) {
+      ssize_t n = read(fd, chunk, sizeof(chunk));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      buffer.append(chunk, n);
+      return true;
+    }
+  }
+};
+
+bool writeAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t n = write(fd, data.data(), data.size());
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data.remove_prefix(n);
+  }
+  return true;
+}
+
+std::string errorReply(const std::string& name, const std::string& message) {
+  return "error " + name + " " + std::to_string(message.size()) + "\n" + message;
+}
+
+}  // namespace
+
+
+CompileServer::OpenFile& CompileServer::openFile(const std::string& name) {
+  auto& file = files[name];
+  if (file == nullptr) {
+    file = std::make_unique<OpenFile>(options);
+  }
+  return *file;
+}
+
+std::string CompileServer::compile(const std::string& name, OpenFile& file) {
+  auto start = std::chrono::steady_clock::now();
+  std::string output, error;
+  if (!file.compiler.compile(file.text, output, error)) {
+    return errorReply(name, error);
+  }
+  auto micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  return "ok " + name + " " + std::to_string(file.compiler.recompiledCount()) + " " + std::to_string(micros) + " " +
+         std::to_string(output.size()) + "\n" + output;
+}
+
+void CompileServer::serve(int in, int out) {
+  FdReader reader(in);
+  std::string header, payload;
+  while (reader.readLine(header)) {
+    std::istringstream fields(header);
+    std::string command, name;
+    fields >> command >> name;
+    if (command == "quit") {
+      return;
+    }
+
+    std::string reply;
+    if (command == "open" || command == "edit") {
+      size_t offset = 0, removed = 0, bytes = 0;
+      if (command == "edit") {
+        fields >> offset >> removed;
+      }
+      fields >> bytes;
+      if (!fields || !reader.readBytes(bytes, payload)) {
+        writeAll(out, errorReply(name, "malformed request: " + header));
+        return;
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if (command == "open") {
+        OpenFile& file = openFile(name);
+        file.text = std::move(payload);
+        reply = compile(name, file);
+      }
+      else {
+        auto it = files.find(name);
+        if (it == files.end()) {
+          reply = errorReply(name, "the file is not open");
+        }
+        else if (offset > it->second->text.size() || removed > it->second->text.size() - offset) {
+          reply = errorReply(name, "the edit is out of range");
+        }
+        else {
+          it->second->text.replace(offset, removed, payload);
+          reply = compile(name, *it->second);
+        }
+      }
+    }
+    else if (command == "close") {
+      std::lock_guard<std::mutex> lock(mutex);
+      files.erase(name);
+      reply = "closed " + name + "\n";
+    }
+    else {
+      reply = errorReply(name, "unknown request: " + header);
+    }
+
+    if (!writeAll(out, reply)) {
+      return;
+    }
+  }
+}
+
+bool CompileServer::listen(const std::string& path) {
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    std::cerr << "socket path is too long: " << path << "\n";
+    return false;
+  }
+  memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  unlink(path.c_str());
+  if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      ::listen(listener, 16) != 0) {
+    std::cerr << "can't listen on " << path << ": " << strerror(errno) << "\n";
+    if (listener >= 0) {
+      close(listener);
+    }
+    return false;
+  }
+
+  // a client going away mid-reply must not take the server down
+  signal(SIGPIPE, SIG_IGN);
+  while (true) {
+    int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      std::cerr << "can't accept a client: " << strerror(errno) << "\n";
+      close(listener);
+      return false;
+    }
+    std::thread([this, client] {
+      serve(client, client);
+      close(client);
+    }).detach();
+  }
+}
+
+bool CompileServer::watch(const std::vector<std::string>& inputs) {
+  int notify = inotify_init1(IN_CLOEXEC);
+  if (notify < 0) {
+    std::cerr << "can't watch files: " << strerror(errno) << "\n";
+    return false;
+  }
+
+  // editors often save by renaming a new file over the old one, so the
+  // directories are watched rather than the files
+  std::map<std::pair<int, std::string>, std::vector<size_t>> watched;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    size_t slash = inputs[i].rfind('/');
+    std::string directory = (slash == std::string::npos) ? "." : inputs[i].substr(0, slash + 1);
+    std::string base = (slash == std::string::npos) ? inputs[i] : inputs[i].substr(slash + 1);
+    int wd = inotify_add_watch(notify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) {
+      std::cerr << "can't watch " << directory << ": " << strerror(errno) << "\n";
+      close(notify);
+      return false;
+    }
+    watched[{ wd, base }].push_back(i);
+  }
+
+  auto rebuild = [&](size_t i) {
+    auto start = std::chrono::steady_clock::now();
+    SourceBuffer source;
+    if (!source.load(inputs[i])) {
+      std::cerr << inputs[i] << ": can't read the input\n";
+      return;
+    }
+    OpenFile& file = openFile(inputs[i]);
+    file.text.assign(source.text());
+    std::string output, error;
+    if (!file.compiler.compile(file.text, output, error)) {
+      std::cerr << inputs[i] << ": " << error << "\n";
+      return;
+    }
+    std::ofstream out(inputs[i] + ".c", std::ios::binary);
+    out << output;
+    auto millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << inputs[i] << ": " << file.compiler.recompiledCount() << " functions recompiled in " << millis
+              << " ms\n";
+  };
+
+  for (size_t i = 0; i < inputs.size(); i++) {
+    rebuild(i);
+  }
+
+  alignas(inotify_event) char events[64 * 1024];
+  while (true) {
+    ssize_t n = read(notify, events, sizeof(events));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      std::cerr << "can't read file events: " << strerror(errno) << "\n";
+      close(notify);
+      return false;
+    }
+
+    // one save may raise several events; rebuild each file once
+    std::set<size_t> changed;
+    for (char *p = events; p < events + n;) {
+      auto *event = reinterpret_cast<inotify_event*>(p);
+      if (event->len > 0) {
+        auto it = watched.find({ event->wd, event->name });
+        if (it != watched.end()) {
+          changed.insert(it->second.begin(), it->second.end());
+        }
+      }
+      p += sizeof(inotify_event) + event->len;
+    }
+    for (auto i : changed) {
+      rebuild(i);
+    }
+  }
+}
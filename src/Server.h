@@ -0,0 +1,65 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "Lowering.h"
+#include "Incremental.h"
+
+
+// Resident compiler. It keeps every open file with its IncrementalCompiler
+// between requests, so an edit only pays for the functions it touches,
+// and the parser's static ATN and DFA caches stay warm.
+//
+// Requests and replies are a header line, followed by a payload when the
+// header ends in a byte count. File names are any text without whitespace
+// and only name the state kept for the file.
+//
+//   open <file> <bytes>\n<text>        sets the whole text of file
+//   edit <file> <offset> <removed> <bytes>\n<text>
+//                                      replaces removed bytes at offset with text
+//   close <file>\n                     drops the state of file
+//   quit\n                             ends the session
+//
+//   ok <file> <recompiled functions> <microseconds> <bytes>\n<C code>
+//   error <file> <bytes>\n<message>
+//   closed <file>\n
+class CompileServer {
+ public:
+  explicit CompileServer(const ParseOptions& _options = ParseOptions()) : options(_options) {}
+
+  // answers the requests read from in on out until quit or the end of input
+  void serve(int in, int out);
+
+  // serves each client of a Unix socket at path on its own thread.
+  // Returns only when the socket cannot be set up.
+  bool listen(const std::string& path);
+
+  // compiles every input to <input>.c, then again whenever one is saved.
+  // Returns only when the files cannot be watched.
+  bool watch(const std::vector<std::string>& inputs);
+
+ private:
+  struct OpenFile {
+    std::string text;
+    IncrementalCompiler compiler;
+
+    explicit OpenFile(const ParseOptions& options) : compiler(options) {}
+  };
+
+  ParseOptions options;
+  // guards files; requests are compiled one at a time
+  std::mutex mutex;
+  std::unordered_map<std::string, std::unique_ptr<OpenFile>> files;
+
+  OpenFile& openFile(const std::string& name);
+  // compiles the current text of file and formats the reply
+  std::string compile(const std::string& name, OpenFile& file);
+  std::string handle(const std::string& header, const std::string& payload);
+};
+
+#endif
@@ -0,0 +1,44 @@
+#include "SlotCoalescing.h"
+
+#include <vector>
+#include <utility>
+
+
+void SlotCoalescer::visit(NodeId node) {
+  for (auto func : ast.list(node)) {
+    slots.clear();
+    freeSlots.clear();
+    // parameters keep their own names in the C signature
+    assignSlots(scopes[ast[func].operands[0]]);
+  }
+}
+
+void SlotCoalescer::assignSlots(ScopeId scope) {
+  std::vector<std::pair<Type*, uint32_t>> taken;
+  for (auto& symbol : scopeTable[scope].symbols) {
+    Type *type = symbol.type->resolved();
+    auto& pool = freeSlots[type];
+    uint32_t slot;
+    if (pool.empty()) {
+      slot = slots.size();
+      slots.emplace_back(scope, symbol.name);
+      symbol.storageScope = NoScope;
+    }
+    else {
+      slot = pool.back();
+      pool.pop_back();
+      symbol.storageScope = slots[slot].first;
+      symbol.storageName = slots[slot].second;
+      sharedVariables++;
+    }
+    taken.emplace_back(type, slot);
+  }
+
+  for (auto child : scopeTable[scope].children) {
+    assignSlots(child);
+  }
+
+  for (auto& entry : taken) {
+    freeSlots[entry.first].push_back(entry.second);
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef SLOT_COALESCING_H_
+#define SLOT_COALESCING_H_
+
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <cstddef>
+
+#include "Type.h"
+#include "AST.h"
+#include "SymbolTable.h"
+
+
+// Lets locals of one type share storage when their scopes are disjoint,
+// such as the two arms of an if. A local is only used inside its scope,
+// so two locals interfere exactly when one's scope encloses the other's.
+// Scopes are walked depth first, and a scope's slots return to a free
+// list of their type when it closes; on a tree this needs the fewest
+// slots. Each local that reuses a slot records the slot's first owner in
+// Symbol::storageScope and storageName.
+class SlotCoalescer {
+ public:
+  SlotCoalescer(const Ast& _ast, ScopeMap& _scopes, ScopeTable& _scopeTable)
+    : ast(_ast), scopes(_scopes), scopeTable(_scopeTable) {}
+
+  const Ast& ast;
+  ScopeMap& scopes;
+  ScopeTable& scopeTable;
+
+  // locals that share another's storage
+  size_t sharedVariables = 0;
+
+  void visit(NodeId node);
+
+ private:
+  // owner of each slot of the current function
+  std::vector<std::pair<ScopeId, SymbolId>> slots;
+  // free slots by resolved type
+  std::unordered_map<Type*, std::vector<uint32_t>> freeSlots;
+
+  void assignSlots(ScopeId scope);
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef SMALL_VECTOR_H_
+#define SMALL_VECTOR_H_
+
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+
+// Vector keeping its first N elements inline, for the many containers that
+// almost always hold a handful of items. Elements must be trivially copyable.
+template <typename T, size_t N>
+class SmallVector {
+  static_assert(std::is_trivially_copyable<T>::value, "SmallVector moves elements with memcpy");
+
+ public:
+  SmallVector() {}
+  SmallVector(const SmallVector& other) { append(other.begin(), other.end()); }
+  SmallVector(SmallVector&& other) noexcept { steal(other); }
+  ~SmallVector() { release(); }
+
+  SmallVector& operator=(const SmallVector& other) {
+    if (this != &other) {
+      count = 0;
+      append(other.begin(), other.end());
+    }
+    return *this;
+  }
+  SmallVector& operator=(SmallVector&& other) noexcept {
+    if (this != &other) {
+      release();
+      steal(other);
+    }
+    return *this;
+  }
+
+  void push_back(const T& value) {
+    if (count == capacity) {
+      T copy = value;  // value may live in the buffer being regrown
+      grow(capacity * 2);
+      items[count++] = copy;
+      return;
+    }
+    items[count++] = value;
+  }
+  void pop_back() { count--; }
+  void clear() { count = 0; }
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  T& operator[](size_t i) { return items[i]; }
+  const T& operator[](size_t i) const { return items[i]; }
+  T& back() { return items[count - 1]; }
+
+  T* begin() { return items; }
+  T* end() { return items + count; }
+  const T* begin() const { return items; }
+  const T* end() const { return items + count; }
+
+ private:
+  T *items = inlineItems();
+  size_t count = 0;
+  size_t capacity = N;
+  alignas(T) unsigned char storage[sizeof(T) * N];
+
+  T* inlineItems() { return reinterpret_cast<T*>(storage); }
+  bool isInline() const { return items == reinterpret_cast<const T*>(storage); }
+
+  void append(const T *first, const T *last) {
+    size_t n = last - first;
+    if (count + n > capacity) {
+      grow(count + n);
+    }
+    std::memcpy(items + count, first, n * sizeof(T));
+    count += n;
+  }
+
+  void grow(size_t newCapacity) {
+    T *newItems = static_cast<T*>(std::malloc(newCapacity * sizeof(T)));
+    if (newItems == nullptr) {
+      throw std::bad_alloc();
+    }
+    std::memcpy(newItems, items, count * sizeof(T));
+    release();
+    items = newItems;
+    capacity = newCapacity;
+  }
+
+  void release() noexcept {
+    if (!isInline()) {
+      std::free(items);
+    }
+    items = inlineItems();
+    capacity = N;
+  }
+
+  void steal(SmallVector& other) noexcept {
+    if (other.isInline()) {
+      std::memcpy(storage, other.storage, other.count * sizeof(T));
+      items = inlineItems();
+      capacity = N;
+    }
+    else {
+      items = other.items;
+      capacity = other.capacity;
+      other.items = other.inlineItems();
+      other.capacity = N;
+    }
+    count = other.count;
+    other.count = 0;
+  }
+};
+
+#endif
@@ -0,0 +1,68 @@
+#include <string>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "SourceBuffer.h"
+
+
+SourceBuffer::~SourceBuffer() {
+  release();
+}
+
+void SourceBuffer::release() {
+  if (mapped != nullptr) {
+    munmap(mapped, size);
+    mapped = nullptr;
+  }
+  owned.clear();
+  data = "";
+  size = 0;
+}
+
+bool SourceBuffer::load(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = loadFd(fd);
+  close(fd);
+  return ok;
+}
+
+bool SourceBuffer::loadFd(int fd) {
+  release();
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      madvise(addr, st.st_size, MADV_SEQUENTIAL);
+      mapped = addr;
+      data = static_cast<const char*>(addr);
+      size = st.st_size;
+      return true;
+    }
+  }
+
+  char chunk[64 * 1024];
+  while (true) {
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return false;
+    }
+    if (n == 0) {
+      break;
+    }
+    owned.append(chunk, n);
+  }
+  data = owned.data();
+  size = owned.size();
+  return true;
+}
@@ -0,0 +1,33 @@
+#ifndef SOURCE_BUFFER_H_
+#define SOURCE_BUFFER_H_
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+
+// Read-only source text. Regular files are memory-mapped so the lexer works
+// on the page cache directly; pipes and terminals are read into memory.
+class SourceBuffer {
+ public:
+  SourceBuffer() {}
+  ~SourceBuffer();
+  SourceBuffer(const SourceBuffer&) = delete;
+  SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+  // false when the file cannot be opened or read
+  bool load(const std::string& path);
+  bool loadFd(int fd);
+
+  std::string_view text() const { return std::string_view(data, size); }
+
+ private:
+  const char *data = "";
+  size_t size = 0;
+  void *mapped = nullptr;
+  std::string owned;
+
+  void release();
+};
+
+#endif
@@ -1,161 +1,163 @@
 #include <iostream>
 #include <string>
-#include <random>
-#include <memory>
-#include <unordered_map>
-
-#include "antlr4-runtime.h"
-#include "TmplangParser.h"
+#include <vector>
 
 #include "Type.h"
+#include "AST.h"
 #include "SymbolTable.h"
 
-using namespace antlr4;
-
 
 
-std::string getRandomString(int len) {
-  static std::string randomchar = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
-  std::random_device rd;
-  std::mt19937 gen(rd());
-  std::uniform_int_distribution<> dist(0, randomchar.length() - 1);
-  std::string out;
-  for (int i = 0; i < len; i++) {
-    out += randomchar[dist(gen)];
+ScopeId ScopeTable::addScope(ScopeKind kind, ScopeId parent, SymbolId name) {
+  ScopeId id = scopes.size();
+  scopes.emplace_back();
+  scopes.back().kind = kind;
+  scopes.back().name = name;
+  scopes.back().parent = parent;
+  if (parent != NoScope) {
+    scopes[parent].children.push_back(id);
   }
-  return out;
+  return id;
 }
 
-
-
-bool Scope::addSymbol(const std::string& name, Type* type) {
-  return symbols.emplace(name, type).second;
-}
-Type* Scope::findSymbol(const std::string& name) {
-  auto it = symbols.find(name);
-  return (it == symbols.end()) ? nullptr : it->second;
+bool ScopeTable::addSymbol(ScopeId scope, SymbolId name, Type* type) {
+  if (findSymbol(scope, name) != nullptr) {
+    return false;
+  }
+  scopes[scope].symbols.push_back(Symbol{ name, type });
+  return true;
 }
-Type* Scope::resolve(const std::string& name) {
-  Scope *scope = this;
-  while (scope != nullptr) {
-    auto it = scope->symbols.find(name);
-    if (it != scope->symbols.end()) {
-      return it->second;
+Type* ScopeTable::findSymbol(ScopeId scope, SymbolId name) {
+  for (auto& symbol : scopes[scope].symbols) {
+    if (symbol.name == name) {
+      return symbol.type;
     }
-    scope = scope->parent;
   }
   return nullptr;
 }
-
-std::shared_ptr<Scope> makeRootScope() {
-  Scope scope;
-  scope.id = "root_" + getRandomString(8);
-  scope.kind = ROOT;
-  scope.parent = nullptr;
-  return std::make_shared<Scope>(scope);
-}
-
-std::shared_ptr<Scope> makeFunctionScope(const std::string& fname, Scope* parent) {
-  Scope scope;
-  scope.id = "function_" + fname + "_" + getRandomString(8);
-  scope.kind = FUNCTION;
-  scope.parent = parent;
-  return std::make_shared<Scope>(scope);
-}
-
-std::shared_ptr<Scope> makeBlockScope(Scope* parent) {
-  Scope scope;
-  scope.id = "block_" + getRandomString(8);
-  scope.kind = BLOCK;
-  scope.parent = parent;
-  return std::make_shared<Scope>(scope);
+Symbol* ScopeTable::findEntry(ScopeId scope, SymbolId name) {
+  for (auto& symbol : scopes[scope].symbols) {
+    if (symbol.name == name) {
+      return &symbol;
+    }
+  }
+  return nullptr;
 }
-
-
-
-void SymbolTableGenerator::enterFile(TmplangParser::FileContext *ctx) {
-  scopes.put(ctx, makeRootScope());
-
-  // move downward
-  currentScope = scopes.get(ctx).get();
+Type* ScopeTable::resolve(ScopeId scope, SymbolId name) {
+  scope = resolveScope(scope, name);
+  return (scope == NoScope) ? nullptr : findSymbol(scope, name);
 }
-
-void SymbolTableGenerator::enterFunctionParamDecl(TmplangParser::FunctionParamDeclContext *ctx) {
-  auto *concreteType = addConcreteType(ctx->type()->getText());
-
-  if (!currentScope->addSymbol(ctx->identifier()->getText(), concreteType)) {
-    std::cout << "param decl collision!!!\n";
+ScopeId ScopeTable::resolveScope(ScopeId scope, SymbolId name) {
+  while (scope != NoScope) {
+    if (findSymbol(scope, name) != nullptr) {
+      return scope;
+    }
+    scope = scopes[scope].parent;
   }
-}
-
-void SymbolTableGenerator::exitFunctionParams(TmplangParser::FunctionParamsContext *ctx) {
-  auto *functionType = dynamic_cast<FunctionType*>(currentFunctionType);
-
-  for (auto *decl : ctx->functionParamDecl()) {
-    auto *symbolType = currentScope->findSymbol(decl->identifier()->getText());
-    if (symbolType == nullptr) {
-      std::cout << "symbol definition not found!!!\n";
+  return NoScope;
+}
+
+std::string ScopeTable::scopeName(ScopeId id, const Interner& names) {
+  switch (scopes[id].kind) {
+    case ROOT:
+      return "root_" + std::to_string(id);
+    case FUNCTION:
+      return "function_" + names.name(scopes[id].name) + "_" + std::to_string(id);
+    default: {
+      // numbered within the enclosing function, so the C emitted for a
+      // function does not depend on the functions before it
+      ScopeId function = id;
+      while (scopes[function].kind == BLOCK) {
+        function = scopes[function].parent;
+      }
+      return "block_" + std::to_string(id - function);
     }
-    functionType->from.push_back(symbolType);
   }
 }
 
-void SymbolTableGenerator::enterFunction(TmplangParser::FunctionContext *ctx) {
-  auto *functionType = addFunctionType();
 
-  if (!currentScope->addSymbol(ctx->identifier()->getText(), functionType)) {
-    std::cout << "function decl collision!!!\n";
-  }
-
-  scopes.put(ctx, makeFunctionScope(ctx->identifier()->getText(), currentScope));
-  currentScope->children.emplace(scopes.get(ctx)->id, scopes.get(ctx).get());
+ScopeId SymbolTableGenerator::enterScope(NodeId node, ScopeKind kind, SymbolId name) {
+  ScopeId scope = scopeTable.addScope(kind, currentScope, name);
+  scopes[node] = scope;
 
   // move downward
-  currentScope = scopes.get(ctx).get();
-  currentFunctionType = functionType;
+  currentScope = scope;
+  return scope;
 }
 
-void SymbolTableGenerator::exitFunction(TmplangParser::FunctionContext *ctx) {
-  // move upward
-  currentScope = currentScope->parent;
-}
-
-void SymbolTableGenerator::enterBlockStatement(TmplangParser::BlockStatementContext *ctx) {
-  scopes.put(ctx, makeBlockScope(currentScope));
-  currentScope->children.emplace(scopes.get(ctx)->id, scopes.get(ctx).get());
-
-  // move downward
-  currentScope = scopes.get(ctx).get();
+Type* SymbolTableGenerator::declaredType(const Node& node) {
+  if (node.hasDeclType) {
+    return types.getConcreteType(node.declType);
+  }
+  return types.addTypeVar();
 }
 
-void SymbolTableGenerator::exitBlockStatement(TmplangParser::BlockStatementContext *ctx) {
-  // move upward
-  currentScope = currentScope->parent;
-}
+void SymbolTableGenerator::visitFunction(NodeId node) {
+  const Node& func = ast[node];
 
-void SymbolTableGenerator::enterIfStatement(TmplangParser::IfStatementContext *ctx) {
-  scopes.put(ctx, makeBlockScope(currentScope));
-  currentScope->children.emplace(scopes.get(ctx)->id, scopes.get(ctx).get());
+  // function types are interned, so the whole signature is built up front
+  std::vector<Type*> paramTypes;
+  for (auto param : ast.list(node)) {
+    paramTypes.push_back(types.getConcreteType(ast[param].declType));
+  }
+  auto *functionType = types.getFunctionType(paramTypes, declaredType(func));
 
-  // move downward
-  currentScope = scopes.get(ctx).get();
-}
+  if (!scopeTable.addSymbol(currentScope, func.name, functionType)) {
+    std::cerr << "function decl collision!!!\n";
+    duplicateNames.push_back(func.name);
+  }
 
-void SymbolTableGenerator::exitIfStatement(TmplangParser::IfStatementContext *ctx) {
-  // move upward
-  currentScope = currentScope->parent;
-}
+  enterScope(node, FUNCTION, func.name);
 
-void SymbolTableGenerator::exitVarDeclStatement(TmplangParser::VarDeclStatementContext *ctx) {
-  Type *varType;
-  if (ctx->type() == nullptr) {
-    varType = addTypeVar();
-  }
-  else {
-    varType = addConcreteType(ctx->type()->getText());
+  for (auto param : ast.list(node)) {
+    if (!scopeTable.addSymbol(currentScope, ast[param].name, types.getConcreteType(ast[param].declType))) {
+      std::cerr << "param decl collision!!!\n";
+      duplicateNames.push_back(ast[param].name);
+    }
   }
+  visit(func.operands[0]);
 
-  if (!currentScope->addSymbol(ctx->identifier()->getText(), varType)) {
-    std::cout << "var decl collision!!!\n";
+  // move upward
+  currentScope = scopeTable[currentScope].parent;
+}
+
+void SymbolTableGenerator::visit(NodeId node) {
+  const Node& n = ast[node];
+  switch (n.kind) {
+    case NodeKind::File:
+      currentScope = NoScope;
+      enterScope(node, ROOT);
+      for (auto func : ast.list(node)) {
+        visitFunction(func);
+      }
+      break;
+
+    case NodeKind::Block:
+      enterScope(node, BLOCK);
+      for (auto stmt : ast.list(node)) {
+        visit(stmt);
+      }
+      currentScope = scopeTable[currentScope].parent;
+      break;
+
+    case NodeKind::If:
+      enterScope(node, BLOCK);
+      visit(n.operands[1]);
+      if (n.operands[2] != NoNode) {
+        visit(n.operands[2]);
+      }
+      currentScope = scopeTable[currentScope].parent;
+      break;
+
+    case NodeKind::VarDecl:
+      if (!scopeTable.addSymbol(currentScope, n.name, declaredType(n))) {
+        std::cerr << "var decl collision!!!\n";
+        duplicateNames.push_back(n.name);
+      }
+      break;
+
+    default:
+      // other statements and expressions declare nothing
+      break;
   }
 }
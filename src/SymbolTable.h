@@ -2,16 +2,14 @@
 #define SYMBOL_TABLE_H_
 
 #include <string>
-#include <unordered_map>
-#include <memory>
-
-#include "antlr4-runtime.h"
-#include "TmplangParser.h"
-#include "TmplangBaseListener.h"
+#include <vector>
+#include <cstdint>
+#include <type_traits>
 
 #include "Type.h"
-
-using namespace antlr4;
+#include "Interner.h"
+#include "SmallVector.h"
+#include "AST.h"
 
 
 enum ScopeKind {
@@ -20,44 +18,77 @@ enum ScopeKind {
   FUNCTION,
   BLOCK,
 };
+
+// index of a scope in its ScopeTable
+using ScopeId = uint32_t;
+constexpr ScopeId NoScope = UINT32_MAX;
+
+struct Symbol {
+  SymbolId name;
+  Type *type;
+  // variable whose storage this one shares once slots are coalesced;
+  // NoScope when it has its own
+  ScopeId storageScope = NoScope;
+  SymbolId storageName = NoSymbol;
+};
 struct Scope {
-  std::string id;
   ScopeKind kind;
-  std::unordered_map<std::string, Type*> symbols;
-  Scope *parent;
-  std::unordered_map<std::string, Scope*> children;
-
-  bool addSymbol(const std::string& name, Type* type);
-  Type* findSymbol(const std::string& name);
-  Type* resolve(const std::string& name);
+  // function name for FUNCTION scopes, NoSymbol otherwise
+  SymbolId name;
+  ScopeId parent;
+  // most scopes declare only a few symbols, so they are scanned linearly
+  SmallVector<Symbol, 4> symbols;
+  SmallVector<ScopeId, 4> children;
 };
+static_assert(std::is_nothrow_move_constructible<Scope>::value, "growing the scope table must move scopes, not copy them");
 
-
-class SymbolTableGenerator : public TmplangBaseListener {
+// All scopes of a compilation, stored contiguously and addressed by ScopeId.
+class ScopeTable {
  public:
-  tree::ParseTreeProperty<std::shared_ptr<Scope>> scopes;
-  Type *currentFunctionType;
-  Scope *currentScope;
+  ScopeId addScope(ScopeKind kind, ScopeId parent, SymbolId name = NoSymbol);
+
+  Scope& operator[](ScopeId id) { return scopes[id]; }
+  size_t size() const { return scopes.size(); }
 
-  void enterFile(TmplangParser::FileContext *ctx) override;
+  bool addSymbol(ScopeId scope, SymbolId name, Type* type);
+  Type* findSymbol(ScopeId scope, SymbolId name);
+  // the entry declaring name in scope itself, nullptr if there is none
+  Symbol* findEntry(ScopeId scope, SymbolId name);
+  Type* resolve(ScopeId scope, SymbolId name);
+  // scope declaring name as seen from scope, NoScope if it is undeclared
+  ScopeId resolveScope(ScopeId scope, SymbolId name);
 
-  void enterFunctionParamDecl(TmplangParser::FunctionParamDeclContext *ctx) override;
+  // unique, printable name of a scope, used to mangle hoisted variables
+  std::string scopeName(ScopeId id, const Interner& names);
 
-  void exitFunctionParams(TmplangParser::FunctionParamsContext *ctx) override;
+ private:
+  std::vector<Scope> scopes;
+};
 
-  void enterFunction(TmplangParser::FunctionContext *ctx) override;
 
-  void exitFunction(TmplangParser::FunctionContext *ctx) override;
+// scope opened by each File, Function, Block and If node; NoScope elsewhere
+using ScopeMap = NodeTable<ScopeId>;
 
-  void enterBlockStatement(TmplangParser::BlockStatementContext *ctx) override;
+class SymbolTableGenerator {
+ public:
+  SymbolTableGenerator(const Ast& _ast, TypeContext& _types, ScopeTable& _scopeTable)
+    : ast(_ast), types(_types), scopeTable(_scopeTable), scopes(_ast, NoScope) {}
 
-  void exitBlockStatement(TmplangParser::BlockStatementContext *ctx) override;
+  const Ast& ast;
+  TypeContext& types;
+  ScopeTable& scopeTable;
+  ScopeMap scopes;
+  ScopeId currentScope;
+  // names declared twice in one scope, in the order they were met
+  std::vector<SymbolId> duplicateNames;
 
-  void enterIfStatement(TmplangParser::IfStatementContext *ctx) override;
+  void visit(NodeId node);
 
-  void exitIfStatement(TmplangParser::IfStatementContext *ctx) override;
+ private:
+  void visitFunction(NodeId node);
 
-  void exitVarDeclStatement(TmplangParser::VarDeclStatementContext *ctx) override;
+  ScopeId enterScope(NodeId node, ScopeKind kind, SymbolId name = NoSymbol);
+  Type* declaredType(const Node& node);
 };
 
 #endif
@@ -0,0 +1,160 @@
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <utility>
+#include <algorithm>
+#include <iterator>
+
+#include "ThreadPool.h"
+
+
+// pool and worker the current thread belongs to, if it is a worker
+static thread_local const ThreadPool *currentPool = nullptr;
+static thread_local unsigned currentWorker = 0;
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (unsigned i = 0; i < threadCount; i++) {
+    workers.push_back(std::make_unique<Worker>());
+  }
+  for (unsigned i = 0; i < threadCount; i++) {
+    threads.emplace_back(&ThreadPool::run, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task, TaskGroup *group) {
+  unsigned target = (currentPool == this) ? currentWorker : nextWorker++ % workers.size();
+  pending++;
+  // counted before it is visible, so a thread that takes it never sees a count underflow
+  queued++;
+  if (group != nullptr) {
+    group->unfinished++;
+    group->queued++;
+  }
+  {
+    std::lock_guard<std::mutex> lock(workers[target]->mutex);
+    workers[target]->tasks.push_back(Task{ std::move(task), group });
+  }
+  if (sleepingWorkers > 0) {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    wake.notify_one();
+  }
+  if (group != nullptr) {
+    notifyWaiters();
+  }
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(sleepMutex);
+  idle.wait(lock, [this] { return pending == 0; });
+}
+
+// takes the newest task of the own deque, else the oldest of another one;
+// with a group, only tasks of that group
+bool ThreadPool::takeTask(unsigned self, const TaskGroup *group, Task& task) {
+  if (group != nullptr && group->queued == 0) {
+    return false;
+  }
+  for (unsigned i = 0; i < workers.size(); i++) {
+    Worker& worker = *workers[(self + i) % workers.size()];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty()) {
+      continue;
+    }
+    auto it = worker.tasks.end();
+    if (group == nullptr) {
+      it = (i == 0) ? std::prev(worker.tasks.end()) : worker.tasks.begin();
+    }
+    else if (i == 0) {
+      auto found = std::find_if(worker.tasks.rbegin(), worker.tasks.rend(),
+                                [group](const Task& t) { return t.group == group; });
+      it = (found == worker.tasks.rend()) ? worker.tasks.end() : std::prev(found.base());
+    }
+    else {
+      it = std::find_if(worker.tasks.begin(), worker.tasks.end(), [group](const Task& t) { return t.group == group; });
+    }
+    if (it == worker.tasks.end()) {
+      continue;
+    }
+    task = std::move(*it);
+    worker.tasks.erase(it);
+    queued--;
+    if (task.group != nullptr) {
+      task.group->queued--;
+    }
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::runTask(Task& task) {
+  task.run();
+  task.run = nullptr;
+  // the group may be gone once its last task is counted, so it is not touched after
+  if (task.group != nullptr && --task.group->unfinished == 0) {
+    notifyWaiters();
+  }
+  if (--pending == 0) {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    idle.notify_all();
+  }
+}
+
+void ThreadPool::notifyWaiters() {
+  if (sleepingWaiters > 0) {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    progress.notify_all();
+  }
+}
+
+void ThreadPool::wait(TaskGroup& group) {
+  unsigned self = (currentPool == this) ? currentWorker : 0;
+  Task task;
+  while (group.unfinished > 0) {
+    if (takeTask(self, &group, task)) {
+      runTask(task);
+      continue;
+    }
+    // the rest of the group runs on other threads
+    sleepingWaiters++;
+    {
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      progress.wait(lock, [&group] { return group.unfinished == 0 || group.queued > 0; });
+    }
+    sleepingWaiters--;
+  }
+}
+
+void ThreadPool::run(unsigned self) {
+  currentPool = this;
+  currentWorker = self;
+
+  Task task;
+  while (true) {
+    if (takeTask(self, nullptr, task)) {
+      runTask(task);
+      continue;
+    }
+
+    sleepingWorkers++;
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    wake.wait(lock, [this] { return stopping || queued > 0; });
+    sleepingWorkers--;
+    if (stopping && queued == 0) {
+      return;
+    }
+  }
+}
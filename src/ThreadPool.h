@@ -0,0 +1,85 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+
+// Tasks submitted together so one thread can wait for just them. The
+// counts are kept by the pool.
+struct TaskGroup {
+  // tasks of the group sitting in some deque, and tasks not yet finished
+  std::atomic<size_t> queued{0};
+  std::atomic<size_t> unfinished{0};
+};
+
+// Fixed set of workers, each with its own task deque. A worker runs its own
+// tasks newest first and, once out of work, steals the oldest task of
+// another worker, so uneven tasks (one huge file among small ones) still
+// keep every core busy.
+class ThreadPool {
+ public:
+  // 0 means one worker per hardware thread
+  explicit ThreadPool(unsigned threadCount = 0);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // tasks submitted from a worker go to that worker's deque,
+  // others are spread over the workers round robin
+  void submit(std::function<void()> task, TaskGroup *group = nullptr);
+
+  // blocks until every submitted task, including ones submitted by tasks, has run
+  void wait();
+
+  // runs tasks of group on the calling thread until all of them have run,
+  // so a task can wait for its subtasks without taking a worker away.
+  // Other tasks are left to the workers.
+  void wait(TaskGroup& group);
+
+  unsigned size() const { return workers.size(); }
+
+ private:
+  struct Task {
+    std::function<void()> run;
+    TaskGroup *group;
+  };
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+  std::atomic<unsigned> nextWorker{0};
+
+  // taken only to sleep and to wake sleepers; the counts are atomic
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  std::condition_variable idle;
+  // wakes threads waiting for a group
+  std::condition_variable progress;
+  // tasks sitting in some deque, and tasks not yet finished
+  std::atomic<size_t> queued{0};
+  std::atomic<size_t> pending{0};
+  // threads asleep on wake and on progress. A thread counts itself before
+  // it checks what it waits for, and a waker changes that before it reads
+  // the count, so one of them always sees the other.
+  std::atomic<unsigned> sleepingWorkers{0};
+  std::atomic<unsigned> sleepingWaiters{0};
+  bool stopping = false;
+
+  bool takeTask(unsigned self, const TaskGroup *group, Task& task);
+  void runTask(Task& task);
+  void notifyWaiters();
+  void run(unsigned self);
+};
+
+#endif
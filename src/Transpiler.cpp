@@ -2,161 +2,346 @@
 
 #include <string>
 #include <queue>
+#include <cstdio>
+#include <cstdint>
 
-#include "HMTypeInference.h"
 #include "Type.h"
 
 
-Transpiler::Transpiler(tree::ParseTreeProperty<std::shared_ptr<Scope>>& _scopes, std::unordered_map<int, Type*> _subst) : scopes(_scopes), subst(_subst) {
+Transpiler::Transpiler(const Ast& _ast, ScopeMap& _scopes, ScopeTable& _scopeTable, const Interner& _names,
+                       OutputSink& sink)
+  : out(sink), ast(_ast), scopes(_scopes), scopeTable(_scopeTable), names(_names) {
 }
 
-antlrcpp::Any Transpiler::visitFile(TmplangParser::FileContext *ctx) {
-  currentScope = scopes.get(ctx).get();
-  indentLevel = 0;
+void Transpiler::visit(NodeId node) {
+  const Node& n = ast[node];
+  switch (n.kind) {
+    case NodeKind::File:
+      currentScope = scopes[node];
+      indentLevel = 0;
+
+      // a static helper may be called above its definition, and C would
+      // declare it implicitly as extern there
+      for (auto func : ast.list(node)) {
+        if (staticFunctions.count(func) != 0) {
+          emitSignature(func);
+          out << ";\n";
+        }
+      }
+      if (!staticFunctions.empty()) {
+        out << "\n";
+      }
+
+      for (auto func : ast.list(node)) {
+        visitFunction(func);
+      }
+      break;
+
+    case NodeKind::Block:
+      visitBlockStatement(node, false);
+      break;
+
+    case NodeKind::If:
+      visitIfStatement(node);
+      break;
+
+    case NodeKind::VarDecl:
+      if (n.operands[0] == NoNode) {
+        // TODO: needs to print a default value
+        break;
+      }
+      // fall through
+    case NodeKind::Assign:
+      out.indent(indentLevel);
+      emitVariable(n.name);
+      out << " = ";
+
+      visitExpr(n.operands[0]);
+
+      out << ";\n";
+      break;
+
+    case NodeKind::Return:
+      out.indent(indentLevel) << "return";
+      if (n.operands[0] != NoNode) {
+        out << " ";
+        visitExpr(n.operands[0]);
+      }
+      out << ";\n";
+      break;
+
+    case NodeKind::ExprStmt: {
+      out.indent(indentLevel);
+
+      // the value of anything but a call is discarded explicitly, as dead
+      // store elimination keeps the whole value of a dead let that calls
+      // a function, and C warns about an unused value
+      NodeId expr = n.operands[0];
+      while (ast[expr].kind == NodeKind::Paren) {
+        expr = ast[expr].operands[0];
+      }
+      if (ast[expr].kind == NodeKind::Call) {
+        visitExpr(expr);
+      }
+      else {
+        out << "(void)(";
+        visitExpr(expr);
+        out << ")";
+      }
+
+      out << ";\n";
+      break;
+    }
 
-  for (auto *func : ctx->function()) {
-    visit(func);
+    default:
+      break;
   }
-  return antlrcpp::Any();
 }
 
-antlrcpp::Any Transpiler::visitFunction(TmplangParser::FunctionContext *ctx) {
-  currentFunctionType = applyUnifier(currentScope->findSymbol(ctx->identifier()->getText()), subst);
-  currentScope = scopes.get(ctx).get();
-
-  Type *returnType = applyUnifier(dynamic_cast<FunctionType*>(currentFunctionType)->to, subst);
+void Transpiler::visitTopLevelFunction(NodeId node) {
+  currentScope = scopes[ast.root];
+  indentLevel = 0;
+  visitFunction(node);
+}
 
-  oss << dynamic_cast<ConcreteType*>(returnType)->name << " " << ctx->identifier()->getText() << "(";
+void Transpiler::emitSignature(NodeId node) {
+  const Node& func = ast[node];
+  ScopeId scope = scopes[node];
+  Type *functionType = scopeTable.findSymbol(scopeTable[scope].parent, func.name)->resolved();
+  Type *returnType = functionType->as<FunctionType>()->to;
 
-  if (ctx->functionParams() != nullptr) {
-    visit(ctx->functionParams());
+  if (staticFunctions.count(node) != 0) {
+    out << "static inline ";
   }
+  out << returnType->as<ConcreteType>()->name() << " " << names.name(func.name) << "(";
 
-  oss << ")";
-
-  visit(ctx->blockStatement());
-  oss << "\n";
-
-  currentScope = currentScope->parent;
-  return antlrcpp::Any();
-}
-
-antlrcpp::Any Transpiler::visitFunctionParams(TmplangParser::FunctionParamsContext *ctx) {
-  for (auto i = 0; i < ctx->functionParamDecl().size(); i++) {
+  auto params = ast.list(node);
+  for (auto i = 0; i < params.size(); i++) {
     // we don't need to infer function param type, because it always needs to be concrete.
-    Type *paramType = currentScope->findSymbol(ctx->functionParamDecl()[i]->identifier()->getText());
-    oss << dynamic_cast<ConcreteType*>(paramType)->name << " " << ctx->functionParamDecl()[i]->identifier()->getText();
-    if (i + 1 < ctx->functionParamDecl().size()) {
-      oss << ", ";
+    Type *paramType = scopeTable.findSymbol(scope, ast[params[i]].name);
+    out << paramType->as<ConcreteType>()->name() << " " << names.name(ast[params[i]].name);
+    if (i + 1 < params.size()) {
+      out << ", ";
     }
   }
-  return antlrcpp::Any();
+
+  out << ")";
 }
 
-std::vector<std::pair<std::string, Type*>> Transpiler::emitAllVarDecls(Scope *root) {
-  std::vector<std::pair<std::string, Type*>> results;
+void Transpiler::visitFunction(NodeId node) {
+  const Node& func = ast[node];
+  currentFunctionType = scopeTable.findSymbol(currentScope, func.name)->resolved();
+  emitSignature(node);
+  currentScope = scopes[node];
+
+  visitBlockStatement(func.operands[0], true);
+  out << "\n";
 
-  std::queue<Scope*> q;
+  currentScope = scopeTable[currentScope].parent;
+}
+
+void Transpiler::emitAllVarDecls(ScopeId root) {
+  std::queue<ScopeId> q;
   q.push(root);
   while (!q.empty()) {
-    Scope *scope = q.front();
+    ScopeId scope = q.front();
     q.pop();
 
-    for (auto& kv : scope->symbols) {
-      results.emplace_back(kv.first + "_" + scope->id, kv.second);
+    for (auto& symbol : scopeTable[scope].symbols) {
+      if (symbol.storageScope != NoScope) {
+        // declared by the variable it shares storage with
+        continue;
+      }
+      Type* varType = symbol.type->resolved();
+      out.indent(indentLevel) << varType->as<ConcreteType>()->name() << " " << names.name(symbol.name) << "_"
+                              << scopeName(scope) << ";\n";
     }
 
-    for (auto& kv : scope->children) {
-      q.push(kv.second);
+    for (auto child : scopeTable[scope].children) {
+      q.push(child);
     }
   }
+}
+
+const std::string& Transpiler::scopeName(ScopeId scope) {
+  if (scope >= scopeNames.size()) {
+    scopeNames.resize(scopeTable.size());
+  }
+  if (scopeNames[scope].empty()) {
+    scopeNames[scope] = scopeTable.scopeName(scope, names);
+  }
+  return scopeNames[scope];
+}
 
-  return results;
+void Transpiler::emitVariable(SymbolId name) {
+  ScopeId scope = scopeTable.resolveScope(currentScope, name);
+  // params and functions keep their source names; locals are hoisted under mangled names
+  if (scope == NoScope || scopeTable[scope].kind != BLOCK) {
+    out << names.name(name);
+    return;
+  }
+  const Symbol *symbol = scopeTable.findEntry(scope, name);
+  if (symbol->storageScope != NoScope) {
+    name = symbol->storageName;
+    scope = symbol->storageScope;
+  }
+  out << names.name(name) << "_" << scopeName(scope);
 }
 
-antlrcpp::Any Transpiler::visitBlockStatement(TmplangParser::BlockStatementContext *ctx) {
-  currentScope = scopes.get(ctx).get();
+void Transpiler::visitBlockStatement(NodeId node, bool isFunctionBody) {
+  currentScope = scopes[node];
 
-  oss << std::string(indentLevel * 2, ' ') << "{\n";
+  out.indent(indentLevel) << "{\n";
   indentLevel++;
 
   // when a block is function-starting block, prints all variable declarations first.
-  if (dynamic_cast<TmplangParser::FunctionContext*>(ctx->parent) != nullptr) {
-    auto decls = emitAllVarDecls(currentScope);
-    for (auto& decl : decls) {
-      Type* varType = applyUnifier(decl.second, subst);
-      oss << std::string(indentLevel * 2, ' ') << dynamic_cast<ConcreteType*>(varType)->name << " " << decl.first << ";\n";
-    }
+  if (isFunctionBody) {
+    emitAllVarDecls(currentScope);
   }
-  oss << "\n";
+  out << "\n";
 
-  visitChildren(ctx);
+  for (auto stmt : ast.list(node)) {
+    visit(stmt);
+  }
 
   indentLevel--;
-  oss << std::string(indentLevel * 2, ' ') << "}\n";
+  out.indent(indentLevel) << "}\n";
 
-  currentScope = currentScope->parent;
-  return antlrcpp::Any();
+  currentScope = scopeTable[currentScope].parent;
 }
 
-antlrcpp::Any Transpiler::visitIfStatement(TmplangParser::IfStatementContext *ctx) {
-  currentScope = scopes.get(ctx).get();
+void Transpiler::visitIfStatement(NodeId node) {
+  const Node& n = ast[node];
+  currentScope = scopes[node];
 
-  oss << std::string(indentLevel * 2, ' ') << "if (";
-  visit(ctx->expr());
-  oss << ")\n";
+  out.indent(indentLevel) << "if (";
+  visitExpr(n.operands[0]);
+  out << ")\n";
 
-  visit(ctx->blockStatement()[0]);
+  visitBlockStatement(n.operands[1], false);
 
-  if (ctx->blockStatement().size() > 1) {
-    oss << std::string(indentLevel * 2, ' ') << "else\n";
-    visit(ctx->blockStatement()[1]);
-  }
-  else if (ctx->ifStatement() != nullptr) {
-    visit(ctx->ifStatement());
+  if (n.operands[2] != NoNode) {
+    out.indent(indentLevel) << "else\n";
+    visit(n.operands[2]);
   }
 
-  currentScope = currentScope->parent;
-  return antlrcpp::Any();
+  currentScope = scopeTable[currentScope].parent;
 }
 
-antlrcpp::Any Transpiler::visitVarDeclStatement(TmplangParser::VarDeclStatementContext *ctx) {
-  if (ctx->expr() == nullptr) {
-    // TODO: needs to print a default value
-    return antlrcpp::Any();
+// C binding strength of an expression node; higher binds tighter.
+static int precedence(NodeKind kind) {
+  switch (kind) {
+    case NodeKind::Equal: return 0;
+    case NodeKind::Add:
+    case NodeKind::Sub: return 1;
+    case NodeKind::Mul:
+    case NodeKind::Div: return 2;
+    case NodeKind::Negate:
+    case NodeKind::Not: return 3;
+    default: return 4;
   }
-
-  oss << std::string(indentLevel * 2, ' ') << ctx->identifier()->getText() << " = ";
-
-  visit(ctx->expr());
-
-  oss << ";\n";
-  return antlrcpp::Any();
-}
-
-antlrcpp::Any Transpiler::visitAssignStatement(TmplangParser::AssignStatementContext *ctx) {
-  oss << std::string(indentLevel * 2, ' ') << ctx->identifier()->getText() << " = ";
-
-  visit(ctx->expr());
-
-  oss << ";\n";
-  return antlrcpp::Any();
 }
 
-antlrcpp::Any Transpiler::visitReturnStatement(TmplangParser::ReturnStatementContext *ctx) {
-  oss << std::string(indentLevel * 2, ' ') << "return ";
-
-  visit(ctx->expr());
-
-  oss << ";\n";
-  return antlrcpp::Any();
+static const char* binaryOperator(NodeKind kind) {
+  switch (kind) {
+    case NodeKind::Mul: return " * ";
+    case NodeKind::Div: return " / ";
+    case NodeKind::Add: return " + ";
+    case NodeKind::Sub: return " - ";
+    default: return " == ";
+  }
 }
 
-antlrcpp::Any Transpiler::visitNormalStatement(TmplangParser::NormalStatementContext *ctx) {
-  oss << std::string(indentLevel * 2, ' ');
+void Transpiler::visitExpr(NodeId node) {
+  const Node& n = ast[node];
+
+  // parenthesizes an operand that binds looser than its position requires
+  auto operand = [&](NodeId child, int minPrecedence) {
+    bool paren = precedence(ast[child].kind) < minPrecedence;
+    if (paren) out << "(";
+    visitExpr(child);
+    if (paren) out << ")";
+  };
+
+  switch (n.kind) {
+    case NodeKind::Call: {
+      operand(n.operands[0], 4);
+      out << "(";
+      auto args = ast.list(node);
+      for (auto i = 0; i < args.size(); i++) {
+        visitExpr(args[i]);
+        if (i + 1 < args.size()) {
+          out << ", ";
+        }
+      }
+      out << ")";
+      break;
+    }
 
-  visit(ctx->expr());
+    case NodeKind::Negate:
+      out << "-";
+      // keep "- -x" from reading as a decrement
+      operand(n.operands[0], (ast[n.operands[0]].kind == NodeKind::Negate) ? 4 : 3);
+      break;
+
+    case NodeKind::Not:
+      out << "!";
+      operand(n.operands[0], 3);
+      break;
+
+    case NodeKind::Paren:
+      out << "(";
+      visitExpr(n.operands[0]);
+      out << ")";
+      break;
+
+    case NodeKind::Mul:
+    case NodeKind::Div:
+    case NodeKind::Add:
+    case NodeKind::Sub:
+    case NodeKind::Equal:
+      // operators are left associative, so only the right operand needs a tighter binding
+      operand(n.operands[0], precedence(n.kind));
+      out << binaryOperator(n.kind);
+      operand(n.operands[1], precedence(n.kind) + 1);
+      break;
+
+    case NodeKind::VarRef:
+      emitVariable(n.name);
+      break;
+
+    case NodeKind::IntLiteral:
+      // folding can leave INT_MIN, whose literal would be a long in C
+      if (n.value == INT32_MIN) {
+        out << "(-2147483647 - 1)";
+      }
+      else if (n.value < 0) {
+        out << "(" << n.value << ")";
+      }
+      else {
+        out << n.value;
+      }
+      break;
+
+    case NodeKind::BoolLiteral:
+      out << (n.value ? "true" : "false");
+      break;
+
+    case NodeKind::CharLiteral: {
+      // folded chars may be unprintable
+      char c = static_cast<char>(n.value);
+      if (c >= ' ' && c <= '~' && c != '\'' && c != '\\') {
+        out << "'" << c << "'";
+      }
+      else {
+        char escaped[8];
+        std::snprintf(escaped, sizeof(escaped), "'\\%03o'", static_cast<unsigned char>(c));
+        out << escaped;
+      }
+      break;
+    }
 
-  oss << ";\n";
-  return antlrcpp::Any();
+    default:
+      break;
+  }
 }
@@ -2,54 +2,61 @@
 #define TRANSPILER_H_
 
 #include <vector>
-#include <unordered_map>
+#include <string>
 #include <utility>
-#include <memory>
-#include <sstream>
-
-#include "antlr4-runtime.h"
-#include "TmplangParser.h"
-#include "TmplangBaseVisitor.h"
+#include <unordered_set>
 
 #include "Type.h"
+#include "Interner.h"
+#include "AST.h"
 #include "SymbolTable.h"
-
-using namespace antlr4;
+#include "CodeWriter.h"
 
 
-class Transpiler : public TmplangBaseVisitor {
+class Transpiler {
  public:
-  std::ostringstream oss;
+  CodeWriter out;
   int indentLevel;
 
-  Transpiler(tree::ParseTreeProperty<std::shared_ptr<Scope>>& _scopes, std::unordered_map<int, Type*> _subst);
+  // reads the resolved types left in the symbol table by inferTypes and
+  // writes the C code to sink
+  Transpiler(const Ast& _ast, ScopeMap& _scopes, ScopeTable& _scopeTable, const Interner& _names, OutputSink& sink);
 
-  tree::ParseTreeProperty<std::shared_ptr<Scope>>& scopes;
-  Scope *currentScope;
+  const Ast& ast;
+  ScopeMap& scopes;
+  ScopeTable& scopeTable;
+  const Interner& names;
+  ScopeId currentScope;
   Type *currentFunctionType;
-  std::unordered_map<int, Type*> subst;
+  // function nodes emitted as static inline
+  std::unordered_set<NodeId> staticFunctions;
 
 
-  antlrcpp::Any visitFile(TmplangParser::FileContext *ctx) override;
+  void visit(NodeId node);
 
-  antlrcpp::Any visitFunction(TmplangParser::FunctionContext *ctx) override;
+  // emits one function of the file on its own
+  void visitTopLevelFunction(NodeId node);
 
-  antlrcpp::Any visitFunctionParams(TmplangParser::FunctionParamsContext *ctx) override;
+ private:
+  void visitFunction(NodeId node);
 
-  antlrcpp::Any visitBlockStatement(TmplangParser::BlockStatementContext *ctx) override;
+  // writes the return type, name and parameters of a function
+  void emitSignature(NodeId node);
 
-  antlrcpp::Any visitIfStatement(TmplangParser::IfStatementContext *ctx) override;
+  void visitBlockStatement(NodeId node, bool isFunctionBody);
 
-  antlrcpp::Any visitVarDeclStatement(TmplangParser::VarDeclStatementContext *ctx) override;
+  void visitIfStatement(NodeId node);
 
-  antlrcpp::Any visitAssignStatement(TmplangParser::AssignStatementContext *ctx) override;
+  void visitExpr(NodeId node);
 
-  antlrcpp::Any visitReturnStatement(TmplangParser::ReturnStatementContext *ctx) override;
+  // writes the C name of a variable as seen from the current scope
+  void emitVariable(SymbolId name);
 
-  antlrcpp::Any visitNormalStatement(TmplangParser::NormalStatementContext *ctx) override;
+  void emitAllVarDecls(ScopeId root);
 
- private:
-  std::vector<std::pair<std::string, Type*>> emitAllVarDecls(Scope *root);
+  // ScopeTable::scopeName of each scope, filled in as scopes are emitted
+  std::vector<std::string> scopeNames;
+  const std::string& scopeName(ScopeId scope);
 
 };
 
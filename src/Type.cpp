@@ -1,91 +1,124 @@
 #include <vector>
 #include <memory>
 #include <iostream>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#include <mutex>
 
 #include "Type.h"
 
 
-Type::~Type() {
+Arena::Arena(size_t _chunkSize) : chunkSize(_chunkSize) {
 }
 
-
-TypeVar::~TypeVar() {
+void* Arena::allocate(size_t size, size_t align) {
+  size_t padding = (align - reinterpret_cast<uintptr_t>(cursor) % align) % align;
+  if (cursor == nullptr || padding + size > static_cast<size_t>(limit - cursor)) {
+    // chunks come from operator new[], which is suitably aligned for any type
+    size_t newChunkSize = std::max(chunkSize, size);
+    chunks.push_back(std::make_unique<char[]>(newChunkSize));
+    cursor = chunks.back().get();
+    limit = cursor + newChunkSize;
+    padding = 0;
+  }
+  void *result = cursor + padding;
+  cursor += padding + size;
+  allocated += size;
+  return result;
 }
 
-void TypeVar::print() {
-  std::cout << "Var (id: " << id << ")";
-}
 
-bool TypeVar::equal(Type *rhs) {
-  auto *t = dynamic_cast<TypeVar*>(rhs);
-  return t != nullptr && id == t->id;
+const char* ConcreteType::name() const {
+  switch (primitive) {
+    case PrimitiveKind::Int: return "int";
+    case PrimitiveKind::Float: return "float";
+    case PrimitiveKind::Char: return "char";
+    case PrimitiveKind::Bool: return "bool";
+  }
+  return "";
 }
 
 
-ConcreteType::ConcreteType() {
-}
+struct TypePrinter {
+  std::ostream& out;
 
-ConcreteType::ConcreteType(std::string&& _name): name(_name) {
-}
+  void operator()(TypeVar *type) {
+    out << "Var (id: " << type->id << ")";
+  }
+  void operator()(ConcreteType *type) {
+    out << "Concrete " << type->name();
+  }
+  void operator()(FunctionType *type) {
+    out << "Func (";
+    for (auto arg : type->from) {
+      arg->print(out);
+      out << ", ";
+    }
+    out << ") -> ";
+    type->to->print(out);
+  }
+};
 
-ConcreteType::~ConcreteType() {
+void Type::print(std::ostream& out) {
+  visitType(this, TypePrinter{ out });
 }
 
-void ConcreteType::print() {
-  std::cout << "Concrete " << name;
-}
 
-bool ConcreteType::equal(Type *rhs) {
-  auto *t = dynamic_cast<ConcreteType*>(rhs);
-  return t != nullptr && name == t->name;
+size_t TypeContext::FunctionTypeHash::operator()(const FunctionType *type) const {
+  size_t hash = std::hash<Type*>{}(type->to);
+  for (auto *arg : type->from) {
+    hash = hash * 31 + std::hash<Type*>{}(arg);
+  }
+  return hash;
 }
 
-
-FunctionType::~FunctionType() {
+bool TypeContext::FunctionTypeEqual::operator()(const FunctionType *lhs, const FunctionType *rhs) const {
+  return lhs->to == rhs->to && std::equal(lhs->from.begin(), lhs->from.end(), rhs->from.begin(), rhs->from.end());
 }
 
-void FunctionType::print() {
-  std::cout << "Func (";
-  for (auto arg : from) {
-    arg->print();
-    std::cout << ", ";
+TypeContext::TypeContext() {
+  for (auto primitive : { PrimitiveKind::Int, PrimitiveKind::Float, PrimitiveKind::Char, PrimitiveKind::Bool }) {
+    primitives[static_cast<int>(primitive)] = arena.create<ConcreteType>(primitive);
   }
-  std::cout << ") -> ";
-  to->print();
 }
 
-bool FunctionType::equal(Type *rhs) {
-  auto *t = dynamic_cast<FunctionType*>(rhs);
-  if (t == nullptr || !to->equal(t->to)) return false;
-  if (from.size() != t->from.size()) return false;
-  for (int i = 0; i < from.size(); i++) {
-    if (!from[i]->equal(t->from[i])) return false;
-  }
-  return true;
+TypeVar* TypeContext::addTypeVar() {
+  auto *type = arena.create<TypeVar>();
+  type->id = typeVars.size();
+  typeVars.push_back(type);
+  return type;
 }
 
-static std::vector<std::unique_ptr<Type>>& getTypeDump() {
-  static std::vector<std::unique_ptr<Type>> typeDump;
-  return typeDump;
+ConcreteType* TypeContext::getConcreteType(const std::string& name) {
+  if (name == "int") return intType();
+  if (name == "float") return floatType();
+  if (name == "char") return charType();
+  if (name == "bool") return boolType();
+  return nullptr;
 }
 
-TypeVar* addTypeVar() {
-  static int typecounter = 0;
-  TypeVar type;
-  type.id = typecounter++;
-  getTypeDump().push_back(std::make_unique<TypeVar>(type));
-  return dynamic_cast<TypeVar*>(getTypeDump().back().get());
-}
+FunctionType* TypeContext::getFunctionType(const std::vector<Type*>& from, Type *to) {
+  FunctionType probe;
+  probe.from.items = const_cast<Type**>(from.data());
+  probe.from.count = from.size();
+  probe.to = to;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = functionTypes.find(&probe);
+  if (it != functionTypes.end()) {
+    return *it;
+  }
 
-ConcreteType* addConcreteType(const std::string& name) {
-  ConcreteType type;
-  type.name = name;
-  getTypeDump().push_back(std::make_unique<ConcreteType>(type));
-  return dynamic_cast<ConcreteType*>(getTypeDump().back().get());
+  auto *type = arena.create<FunctionType>();
+  type->from.items = static_cast<Type**>(arena.allocate(sizeof(Type*) * from.size(), alignof(Type*)));
+  type->from.count = from.size();
+  std::copy(from.begin(), from.end(), type->from.items);
+  type->to = to;
+  functionTypes.insert(type);
+  return type;
 }
 
-FunctionType* addFunctionType() {
-  FunctionType type;
-  getTypeDump().push_back(std::make_unique<FunctionType>(type));
-  return dynamic_cast<FunctionType*>(getTypeDump().back().get());
+std::vector<FunctionType*> TypeContext::allFunctionTypes() const {
+  return std::vector<FunctionType*>(functionTypes.begin(), functionTypes.end());
 }
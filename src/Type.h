@@ -3,41 +3,194 @@
 
 #include <vector>
 #include <string>
+#include <iostream>
+#include <memory>
+#include <unordered_set>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
 
+
+// Bump allocator for objects that live as long as their owner.
+// Only trivially destructible objects may be placed in it.
+class Arena {
+ public:
+  explicit Arena(size_t chunkSize = 64 * 1024);
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* allocate(size_t size, size_t align);
+
+  template <typename T, typename... Args>
+  T* create(Args&&... args) {
+    static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+    return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  size_t bytesAllocated() const { return allocated; }
+
+ private:
+  std::vector<std::unique_ptr<char[]>> chunks;
+  size_t chunkSize;
+  char *cursor = nullptr;
+  char *limit = nullptr;
+  size_t allocated = 0;
+};
+
+
+enum class TypeKind : uint8_t {
+  Var,
+  Concrete,
+  Function,
+};
+enum class PrimitiveKind : uint8_t {
+  Int,
+  Float,
+  Char,
+  Bool,
+};
+
+struct TypeVar;
+struct ConcreteType;
+struct FunctionType;
+
+// Types are told apart by their kind tag rather than RTTI.
 struct Type {
-  virtual ~Type();
-  virtual void print() = 0;
-  virtual bool equal(Type *rhs) = 0;
+  const TypeKind kind;
+
+  explicit Type(TypeKind _kind) : kind(_kind) {}
+
+  // nullptr when this is not a T
+  template <typename T>
+  T* as() { return kind == T::Kind ? static_cast<T*>(this) : nullptr; }
+
+  void print(std::ostream& out = std::cout);
+
+  // final type after inference has been resolved (see Unifier::resolveAll).
+  // Before that, and for type vars left unconstrained, this is the type itself.
+  Type* resolved();
+
+  // types are interned by TypeContext, so structural equality is identity
+  bool equal(Type *rhs) { return this == rhs; }
 };
 struct TypeVar : public Type {
+  static constexpr TypeKind Kind = TypeKind::Var;
+
   int id;
 
-  ~TypeVar();
-  void print();
-  bool equal(Type *rhs);
+  // union-find state owned by the unifier.
+  // parent == nullptr means this var is the representative of its class,
+  // and only a representative carries the non-variable type bound to the class.
+  TypeVar *parent = nullptr;
+  int rank = 0;
+  Type *instance = nullptr;
+
+  // written once by the resolution pass after unification
+  Type *resolution = nullptr;
+
+  TypeVar() : Type(Kind) {}
 };
 struct ConcreteType : public Type {
-  std::string name;
+  static constexpr TypeKind Kind = TypeKind::Concrete;
+
+  PrimitiveKind primitive;
 
-  ConcreteType();
-  ConcreteType(std::string&& _name);
-  ~ConcreteType();
+  explicit ConcreteType(PrimitiveKind _primitive) : Type(Kind), primitive(_primitive) {}
+
+  const char* name() const;
+};
+// fixed-size list of types stored in a TypeContext arena
+struct TypeList {
+  Type **items = nullptr;
+  size_t count = 0;
 
-  void print();
-  bool equal(Type *rhs);
+  size_t size() const { return count; }
+  Type* operator[](size_t i) const { return items[i]; }
+  Type** begin() const { return items; }
+  Type** end() const { return items + count; }
 };
 struct FunctionType : public Type {
-  std::vector<Type*> from;
+  static constexpr TypeKind Kind = TypeKind::Function;
+
+  TypeList from;
   Type *to;
 
-  ~FunctionType();
+  // written once by the resolution pass after unification
+  Type *resolution = nullptr;
 
-  void print();
-  bool equal(Type *rhs);
+  FunctionType() : Type(Kind) {}
 };
 
-TypeVar* addTypeVar();
-ConcreteType* addConcreteType(const std::string& name);
-FunctionType* addFunctionType();
+inline Type* Type::resolved() {
+  Type *resolution = nullptr;
+  if (kind == TypeKind::Var) {
+    resolution = static_cast<TypeVar*>(this)->resolution;
+  }
+  else if (kind == TypeKind::Function) {
+    resolution = static_cast<FunctionType*>(this)->resolution;
+  }
+  return (resolution != nullptr) ? resolution : this;
+}
+
+// Calls the overload of visitor matching the dynamic kind of type.
+template <typename Visitor>
+decltype(auto) visitType(Type *type, Visitor&& visitor) {
+  switch (type->kind) {
+    case TypeKind::Var:
+      return visitor(static_cast<TypeVar*>(type));
+    case TypeKind::Concrete:
+      return visitor(static_cast<ConcreteType*>(type));
+    case TypeKind::Function:
+      break;
+  }
+  return visitor(static_cast<FunctionType*>(type));
+}
+
+
+// Owns every type of one compilation. Primitive types are singletons and
+// function types are hash-consed, so equal types are the same pointer.
+class TypeContext {
+ public:
+  TypeContext();
+  TypeContext(const TypeContext&) = delete;
+  TypeContext& operator=(const TypeContext&) = delete;
+
+  TypeVar* addTypeVar();
+
+  ConcreteType* intType() { return primitives[static_cast<int>(PrimitiveKind::Int)]; }
+  ConcreteType* floatType() { return primitives[static_cast<int>(PrimitiveKind::Float)]; }
+  ConcreteType* charType() { return primitives[static_cast<int>(PrimitiveKind::Char)]; }
+  ConcreteType* boolType() { return primitives[static_cast<int>(PrimitiveKind::Bool)]; }
+  ConcreteType* getConcreteType(PrimitiveKind primitive) { return primitives[static_cast<int>(primitive)]; }
+  // nullptr for a name that is not a primitive type
+  ConcreteType* getConcreteType(const std::string& name);
+
+  // safe to call from several threads at once
+  FunctionType* getFunctionType(const std::vector<Type*>& from, Type *to);
+
+  const std::vector<TypeVar*>& allTypeVars() const { return typeVars; }
+  std::vector<FunctionType*> allFunctionTypes() const;
+
+  int typeVarCount() const { return typeVars.size(); }
+  size_t functionTypeCount() const { return functionTypes.size(); }
+  size_t bytesAllocated() const { return arena.bytesAllocated(); }
+
+ private:
+  struct FunctionTypeHash {
+    size_t operator()(const FunctionType *type) const;
+  };
+  struct FunctionTypeEqual {
+    bool operator()(const FunctionType *lhs, const FunctionType *rhs) const;
+  };
+
+  // guards the arena and functionTypes while function types are interned
+  std::mutex mutex;
+  Arena arena;
+  std::vector<TypeVar*> typeVars;
+  ConcreteType *primitives[4];
+  std::unordered_set<FunctionType*, FunctionTypeHash, FunctionTypeEqual> functionTypes;
+};
 
 #endif
@@ -0,0 +1,195 @@
+#include <iostream>
+#include <vector>
+
+#include "Type.h"
+#include "Interner.h"
+#include "AST.h"
+#include "SymbolTable.h"
+#include "HMTypeInference.h"
+#include "TypeEquations.h"
+
+
+void TypeEquationGenerater::visit(NodeId node) {
+  const Node& n = ast[node];
+  switch (n.kind) {
+    case NodeKind::File: {
+      currentScope = rootScope = scopes[node];
+      NodeList funcs = ast.list(node);
+      functions.resize(funcs.size());
+      for (uint32_t i = 0; i < funcs.size(); i++) {
+        // the first declaration wins on a collision, as in the symbol table
+        functionIndex.emplace(ast[funcs[i]].name, i);
+      }
+      for (uint32_t i = 0; i < funcs.size(); i++) {
+        currentFunction = i;
+        visit(funcs[i]);
+      }
+      break;
+    }
+
+    case NodeKind::Function:
+      currentScope = scopes[node];
+      currentFunctionType = scopeTable.findSymbol(scopeTable[currentScope].parent, n.name);
+      functions[currentFunction].signature = currentFunctionType;
+      visit(n.operands[0]);
+      currentScope = scopeTable[currentScope].parent;
+      break;
+
+    case NodeKind::Block:
+      currentScope = scopes[node];
+      for (auto stmt : ast.list(node)) {
+        visit(stmt);
+      }
+      currentScope = scopeTable[currentScope].parent;
+      break;
+
+    case NodeKind::If: {
+      currentScope = scopes[node];
+      Type *condType = visitExpr(n.operands[0]);
+      visit(n.operands[1]);
+      if (n.operands[2] != NoNode) {
+        visit(n.operands[2]);
+      }
+      Type *ifResultType = types.boolType();
+
+      addEquation(condType, ifResultType);
+      currentScope = scopeTable[currentScope].parent;
+      break;
+    }
+
+    case NodeKind::VarDecl:
+    case NodeKind::Assign: {
+      if (n.operands[0] == NoNode) {
+        break;
+      }
+      Type *valueType = visitExpr(n.operands[0]);
+
+      Type *identifierType = scopeTable.resolve(currentScope, n.name);
+      if (identifierType == nullptr) {
+        std::cerr << "can't find identifier definition!! : " << names.name(n.name) << "\n";
+        undefinedNames.push_back(n.name);
+        identifierType = types.addTypeVar();
+      }
+
+      uint32_t target = referencedFunction(n.name);
+      if (target != NoFunction) {
+        // assigning to a function name; keep its signature on the right
+        addEquation(valueType, identifierType, target);
+      }
+      else {
+        addEquation(identifierType, valueType);
+      }
+      break;
+    }
+
+    case NodeKind::Return:
+      if (n.operands[0] != NoNode) {
+        Type* a = visitExpr(n.operands[0]);
+        Type* b = currentFunctionType->as<FunctionType>()->to;
+        addEquation(a, b);
+      }
+      break;
+
+    case NodeKind::ExprStmt:
+      visitExpr(n.operands[0]);
+      break;
+
+    default:
+      break;
+  }
+}
+
+Type* TypeEquationGenerater::visitExpr(NodeId node) {
+  const Node& n = ast[node];
+  Type *type;
+  switch (n.kind) {
+    case NodeKind::Call: {
+      type = types.addTypeVar();
+      Type *calleeType = visitExpr(n.operands[0]);
+      std::vector<Type*> argTypes;
+      for (auto arg : ast.list(node)) {
+        argTypes.push_back(visitExpr(arg));
+      }
+      auto *functionType = types.getFunctionType(argTypes, type);
+
+      addEquation(calleeType, functionType);
+      break;
+    }
+
+    case NodeKind::Negate:
+    case NodeKind::Not:
+    case NodeKind::Paren:
+      type = types.addTypeVar();
+      addEquation(type, visitExpr(n.operands[0]));
+      break;
+
+    case NodeKind::Mul:
+    case NodeKind::Div:
+    case NodeKind::Add:
+    case NodeKind::Sub: {
+      type = types.addTypeVar();
+      Type *lhsType = visitExpr(n.operands[0]);
+      Type *rhsType = visitExpr(n.operands[1]);
+      addEquation(type, lhsType);
+      addEquation(type, rhsType);
+      break;
+    }
+
+    case NodeKind::Equal: {
+      type = types.addTypeVar();
+      Type *lhsType = visitExpr(n.operands[0]);
+      Type *rhsType = visitExpr(n.operands[1]);
+      auto *equalResultType = types.boolType();
+
+      addEquation(lhsType, rhsType);
+      addEquation(type, equalResultType);
+      break;
+    }
+
+    case NodeKind::VarRef: {
+      type = types.addTypeVar();
+      Type *varType = scopeTable.resolve(currentScope, n.name);
+      if (varType == nullptr) {
+        std::cerr << "can't find variable definition!!! : " << names.name(n.name) << "\n";
+        undefinedNames.push_back(n.name);
+        varType = types.addTypeVar();
+      }
+
+      addEquation(type, varType, referencedFunction(n.name));
+      break;
+    }
+
+    case NodeKind::IntLiteral:
+      type = types.intType();
+      break;
+
+    case NodeKind::BoolLiteral:
+      type = types.boolType();
+      break;
+
+    case NodeKind::CharLiteral:
+      type = types.charType();
+      break;
+
+    default:
+      std::cerr << "unexpected expression node!!\n";
+      type = types.addTypeVar();
+      break;
+  }
+  nodeTypes[node] = type;
+  return type;
+}
+
+void TypeEquationGenerater::addEquation(Type *left, Type *right, uint32_t callee) {
+  auto& function = functions[currentFunction];
+  function.equations.push_back(TypeEquation{ left, right });
+  function.callees.push_back(callee);
+}
+
+uint32_t TypeEquationGenerater::referencedFunction(SymbolId name) {
+  if (scopeTable.resolveScope(currentScope, name) != rootScope) {
+    return NoFunction;
+  }
+  auto it = functionIndex.find(name);
+  return (it != functionIndex.end()) ? it->second : NoFunction;
+}
@@ -0,0 +1,52 @@
+#ifndef TYPE_EQUATIONS_H_
+#define TYPE_EQUATIONS_H_
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "Type.h"
+#include "Interner.h"
+#include "AST.h"
+#include "SymbolTable.h"
+#include "HMTypeInference.h"
+
+
+// Walks the Ast and collects the equations between the types of every
+// expression and the symbols it uses, separately for each top-level function.
+class TypeEquationGenerater {
+ public:
+  TypeEquationGenerater(const Ast& _ast, ScopeMap& _scopes, ScopeTable& _scopeTable, TypeContext& _types, const Interner& _names)
+    : ast(_ast), scopes(_scopes), scopeTable(_scopeTable), types(_types), names(_names), nodeTypes(_ast, nullptr) {}
+
+  const Ast& ast;
+  ScopeMap& scopes;
+  ScopeTable& scopeTable;
+  TypeContext& types;
+  const Interner& names;
+  ScopeId currentScope;
+  Type *currentFunctionType;
+
+  // type of every expression node
+  NodeTable<Type*> nodeTypes;
+  // indexed like the functions of the File node
+  std::vector<FunctionConstraints> functions;
+  // names used with no definition in scope, in the order they were met
+  std::vector<SymbolId> undefinedNames;
+
+  void visit(NodeId node);
+
+  Type* visitExpr(NodeId node);
+
+ private:
+  ScopeId rootScope = NoScope;
+  uint32_t currentFunction = NoFunction;
+  std::unordered_map<SymbolId, uint32_t> functionIndex;
+
+  // top-level function name refers to from the current scope, if any
+  uint32_t referencedFunction(SymbolId name);
+  // callee is set when right is the signature of that function
+  void addEquation(Type *left, Type *right, uint32_t callee = NoFunction);
+};
+
+#endif
@@ -0,0 +1,181 @@
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "Bytecode.h"
+#include "VM.h"
+
+
+// labels as values turn dispatch into one indirect jump per instruction
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+
+VirtualMachine::VirtualMachine(const BytecodeProgram& _program, size_t stackSlots)
+  : program(_program), stack(stackSlots) {
+}
+
+bool VirtualMachine::call(const std::string& name, const std::vector<int64_t>& args, int64_t& result,
+                          std::string& error) {
+  uint32_t function = program.findFunction(name);
+  if (function == NoFunction) {
+    error = "no function named " + name;
+    return false;
+  }
+  return call(function, args, result, error);
+}
+
+bool VirtualMachine::call(uint32_t function, const std::vector<int64_t>& args, int64_t& result, std::string& error) {
+  const BytecodeFunction& callee = program.functions[function];
+  if (args.size() != callee.params.size()) {
+    error = callee.name + " takes " + std::to_string(callee.params.size()) + " arguments";
+    return false;
+  }
+  if (callee.registerCount > stack.size()) {
+    error = "stack overflow";
+    return false;
+  }
+  for (size_t i = 0; i < args.size(); i++) {
+    stack[i] = args[i];
+  }
+  return run(function, result, error);
+}
+
+static inline int64_t wrapInt(uint32_t value) {
+  return static_cast<int32_t>(value);
+}
+
+bool VirtualMachine::run(uint32_t function, int64_t& result, std::string& error) {
+  const Instruction *code = program.code.data();
+  const int64_t *constants = program.constants.data();
+  const BytecodeFunction *functions = program.functions.data();
+  int64_t *stackEnd = stack.data() + stack.size();
+
+  frames.clear();
+  const Instruction *pc = code + functions[function].entry;
+  int64_t *r = stack.data();
+
+#define A (r[pc->a])
+#define B (r[pc->b])
+#define C (r[pc->c])
+
+#ifdef VM_COMPUTED_GOTO
+  // in the order of Opcode
+  static const void *const dispatch[] = {
+    &&op_Move, &&op_LoadConst, &&op_Add, &&op_Sub, &&op_Mul, &&op_Div, &&op_Negate, &&op_Not,
+    &&op_Equal, &&op_TruncChar, &&op_Jump, &&op_JumpIfFalse, &&op_Call, &&op_Return,
+  };
+#define NEXT() goto *dispatch[static_cast<int>(pc->op)]
+#define OP(name) op_##name
+  NEXT();
+#else
+#define NEXT() continue
+#define OP(name) case Opcode::name
+  while (true) switch (pc->op) {
+#endif
+
+  OP(Move):
+    A = B;
+    pc++;
+    NEXT();
+
+  OP(LoadConst):
+    A = constants[pc->wide()];
+    pc++;
+    NEXT();
+
+  OP(Add):
+    A = wrapInt(uint32_t(B) + uint32_t(C));
+    pc++;
+    NEXT();
+
+  OP(Sub):
+    A = wrapInt(uint32_t(B) - uint32_t(C));
+    pc++;
+    NEXT();
+
+  OP(Mul):
+    A = wrapInt(uint32_t(B) * uint32_t(C));
+    pc++;
+    NEXT();
+
+  OP(Div): {
+    int32_t divisor = int32_t(C);
+    if (divisor == 0) {
+      error = "division by zero";
+      return false;
+    }
+    int32_t dividend = int32_t(B);
+    // INT_MIN / -1 overflows; it wraps like the other operators
+    A = (divisor == -1) ? wrapInt(0u - uint32_t(dividend)) : int64_t(dividend / divisor);
+    pc++;
+    NEXT();
+  }
+
+  OP(Negate):
+    A = wrapInt(0u - uint32_t(B));
+    pc++;
+    NEXT();
+
+  OP(Not):
+    A = !B;
+    pc++;
+    NEXT();
+
+  OP(Equal):
+    A = (B == C);
+    pc++;
+    NEXT();
+
+  OP(TruncChar):
+    A = static_cast<signed char>(A);
+    pc++;
+    NEXT();
+
+  OP(Jump):
+    pc = code + pc->wide();
+    NEXT();
+
+  OP(JumpIfFalse):
+    pc = A ? pc + 1 : code + pc->wide();
+    NEXT();
+
+  OP(Call): {
+    const BytecodeFunction& callee = functions[pc->wide()];
+    int64_t *base = r + pc->a;
+    // a frame may start where its caller's does, so the depth is bounded too
+    if (base + callee.registerCount > stackEnd || frames.size() == stack.size()) {
+      error = "stack overflow in " + callee.name;
+      return false;
+    }
+    frames.push_back(Frame{ pc + 1, r });
+    r = base;
+    pc = code + callee.entry;
+    NEXT();
+  }
+
+  OP(Return): {
+    int64_t value = A;
+    if (frames.empty()) {
+      result = value;
+      return true;
+    }
+    // the result replaces the first argument, at the base of the returning frame
+    r[0] = value;
+    pc = frames.back().returnPc;
+    r = frames.back().base;
+    frames.pop_back();
+    NEXT();
+  }
+
+#ifndef VM_COMPUTED_GOTO
+  }
+#endif
+
+#undef A
+#undef B
+#undef C
+#undef NEXT
+#undef OP
+}
@@ -0,0 +1,37 @@
+#ifndef VM_H_
+#define VM_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "Bytecode.h"
+
+
+// Interpreter of a BytecodeProgram. Frames live on one register stack;
+// a call starts the callee's frame at its first argument register.
+// Values are passed as int64_t: ints as their value, bools as 0 or 1 and
+// chars as their code.
+class VirtualMachine {
+ public:
+  explicit VirtualMachine(const BytecodeProgram& _program, size_t stackSlots = 1 << 20);
+
+  // false with a message in error on a runtime error (division by zero,
+  // stack overflow) or when args don't fit the function
+  bool call(uint32_t function, const std::vector<int64_t>& args, int64_t& result, std::string& error);
+  bool call(const std::string& name, const std::vector<int64_t>& args, int64_t& result, std::string& error);
+
+ private:
+  struct Frame {
+    const Instruction *returnPc;
+    int64_t *base;
+  };
+
+  const BytecodeProgram& program;
+  std::vector<int64_t> stack;
+  std::vector<Frame> frames;
+
+  bool run(uint32_t function, int64_t& result, std::string& error);
+};
+
+#endif
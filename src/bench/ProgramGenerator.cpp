@@ -0,0 +1,175 @@
+#include <string>
+#include <vector>
+#include <sstream>
+#include <random>
+#include <algorithm>
+
+#include "ProgramGenerator.h"
+
+
+namespace {
+
+class Generator {
+ public:
+  explicit Generator(const GeneratorOptions& _options) : options(_options), gen(_options.seed) {}
+
+  std::string run() {
+    for (int i = 0; i < options.functions; i++) {
+      function(i);
+    }
+    return out.str();
+  }
+
+ private:
+  const GeneratorOptions& options;
+  std::mt19937 gen;
+  std::ostringstream out;
+  // parameter count of each function written so far
+  std::vector<int> arities;
+  // int and bool variables in scope
+  std::vector<std::string> ints, bools;
+  // calls the current function has yet to make
+  int callsLeft = 0;
+  int nextVariable = 0;
+
+  int below(int n) { return static_cast<int>(gen() % n); }
+  bool chance(double p) { return std::uniform_real_distribution<double>(0, 1)(gen) < p; }
+
+  void indent(int level) {
+    for (int i = 0; i < level; i++) {
+      out << "  ";
+    }
+  }
+
+  void function(int index) {
+    int arity = 1 + below(3);
+    ints.clear();
+    bools.clear();
+    nextVariable = 0;
+    // the first function has nothing to call
+    callsLeft = (index == 0) ? 0 : options.callFanOut;
+
+    out << "fn f" << index << "(";
+    for (int i = 0; i < arity; i++) {
+      ints.push_back("p" + std::to_string(i));
+      out << (i == 0 ? "" : ", ") << "int " << ints.back();
+    }
+    out << ")" << (chance(options.annotatedShare) ? ": int" : "") << " {\n";
+    for (int i = 0; i < options.statements; i++) {
+      statement(0, 1);
+    }
+    // calls no expression happened to make
+    while (callsLeft > 0) {
+      declare("int", call(), 1);
+    }
+    out << "  return " << intExpression(options.expressionDepth) << ";\n";
+    out << "}\n";
+    arities.push_back(arity);
+  }
+
+  // let of a new int or bool variable set to value
+  void declare(const char *type, const std::string& value, int level) {
+    std::string name = "v" + std::to_string(nextVariable++);
+    indent(level);
+    out << "let " << (chance(options.annotatedShare) ? std::string(type) + " " : "") << name << " = " << value << ";\n";
+    (type[0] == 'i' ? ints : bools).push_back(name);
+  }
+
+  void block(int depth, int level) {
+    size_t intCount = ints.size(), boolCount = bools.size();
+    out << "{\n";
+    for (int i = 0; i < options.statements; i++) {
+      statement(depth, level + 1);
+    }
+    indent(level);
+    out << "}";
+    // locals of the block go out of scope
+    ints.resize(intCount);
+    bools.resize(boolCount);
+  }
+
+  void statement(int depth, int level) {
+    int kind = below(depth < options.nestingDepth ? 6 : 4);
+    switch (kind) {
+      case 0:
+      case 1:
+        declare("int", intExpression(options.expressionDepth), level);
+        break;
+      case 2:
+        declare("bool", boolExpression(options.expressionDepth), level);
+        break;
+      case 3:
+        indent(level);
+        out << ints[below(ints.size())] << " = " << intExpression(options.expressionDepth) << ";\n";
+        break;
+      case 4:
+        indent(level);
+        out << "if (" << boolExpression(options.expressionDepth) << ") ";
+        block(depth + 1, level);
+        if (chance(0.5)) {
+          out << " else ";
+          block(depth + 1, level);
+        }
+        out << "\n";
+        break;
+      default:
+        indent(level);
+        block(depth + 1, level);
+        out << "\n";
+        break;
+    }
+  }
+
+  std::string call() {
+    callsLeft--;
+    int callee = below(arities.size());
+    std::string text = "f" + std::to_string(callee) + "(";
+    for (int i = 0; i < arities[callee]; i++) {
+      text += (i == 0 ? "" : ", ") + intExpression(1);
+    }
+    return text + ")";
+  }
+
+  std::string intExpression(int depth) {
+    if (depth == 0 || chance(0.25)) {
+      if (callsLeft > 0 && chance(0.3)) {
+        return call();
+      }
+      if (chance(0.75)) {
+        return ints[below(ints.size())];
+      }
+      return std::to_string(1 + below(99));
+    }
+    switch (below(6)) {
+      case 0:
+        return "-" + intExpression(depth - 1);
+      case 1:
+        // divisors are literals, so a run never divides by zero
+        return "(" + intExpression(depth - 1) + " / " + std::to_string(1 + below(9)) + ")";
+      case 2:
+        return "(" + intExpression(depth - 1) + " * " + intExpression(depth - 1) + ")";
+      case 3:
+        return "(" + intExpression(depth - 1) + " - " + intExpression(depth - 1) + ")";
+      default:
+        return intExpression(depth - 1) + " + " + intExpression(depth - 1);
+    }
+  }
+
+  std::string boolExpression(int depth) {
+    depth = std::max(depth, 1);
+    if (!bools.empty() && chance(0.2)) {
+      return bools[below(bools.size())];
+    }
+    if (chance(0.2)) {
+      return "!(" + intExpression(depth - 1) + " == " + intExpression(depth - 1) + ")";
+    }
+    return "(" + intExpression(depth - 1) + " == " + intExpression(depth - 1) + ")";
+  }
+};
+
+}  // namespace
+
+
+std::string generateProgram(const GeneratorOptions& options) {
+  return Generator(options).run();
+}
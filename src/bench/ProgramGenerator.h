@@ -0,0 +1,28 @@
+#ifndef PROGRAM_GENERATOR_H_
+#define PROGRAM_GENERATOR_H_
+
+#include <string>
+#include <cstdint>
+
+
+// Shape of a generated program. The defaults give a file about the size
+// of test/test1.tmp; benches scale functions from there.
+struct GeneratorOptions {
+  int functions = 10;
+  // statements in each block, and how deep ifs and blocks nest
+  int statements = 4;
+  int nestingDepth = 2;
+  // operators between the root of an expression and its leaves
+  int expressionDepth = 3;
+  // calls made by each function, always to functions defined before it
+  int callFanOut = 2;
+  // share of lets, parameters and results that carry a type annotation
+  double annotatedShare = 0.5;
+  uint32_t seed = 1;
+};
+
+// Source of a program that type checks: every value is an int or a bool,
+// every variable is declared before use and calls form no cycle.
+std::string generateProgram(const GeneratorOptions& options);
+
+#endif
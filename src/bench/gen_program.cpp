@@ -0,0 +1,82 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+
+#include "ProgramGenerator.h"
+
+
+// Writes a generated program to stdout, for feeding the compiler by hand:
+//   gen_program [--functions=N] [--statements=N] [--depth=N]
+//               [--expr-depth=N] [--fan-out=N] [--annotated=SHARE] [--seed=N]
+// Each value may also follow its option as the next argument.
+
+// whole text as an integer from min to max
+static bool parseInt(const std::string& text, long min, long max, long& value) {
+  char *end;
+  errno = 0;
+  value = std::strtol(text.c_str(), &end, 10);
+  return !text.empty() && *end == '\0' && errno == 0 && value >= min && value <= max;
+}
+
+int main(int argc, const char *argv[]) {
+  GeneratorOptions options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    size_t equals = arg.find('=');
+    std::string name = arg.substr(0, equals);
+    std::string value;
+    if (equals != std::string::npos) {
+      value = arg.substr(equals + 1);
+    }
+    else if (i + 1 < argc) {
+      value = argv[++i];
+    }
+
+    // a file needs one function; the other counts may be zero
+    long number = 0;
+    bool valid = true;
+    if (name == "--functions") {
+      valid = parseInt(value, 1, INT_MAX, number);
+      options.functions = number;
+    }
+    else if (name == "--statements") {
+      valid = parseInt(value, 0, INT_MAX, number);
+      options.statements = number;
+    }
+    else if (name == "--depth") {
+      valid = parseInt(value, 0, INT_MAX, number);
+      options.nestingDepth = number;
+    }
+    else if (name == "--expr-depth") {
+      valid = parseInt(value, 0, INT_MAX, number);
+      options.expressionDepth = number;
+    }
+    else if (name == "--fan-out") {
+      valid = parseInt(value, 0, INT_MAX, number);
+      options.callFanOut = number;
+    }
+    else if (name == "--annotated") {
+      char *end;
+      options.annotatedShare = std::strtod(value.c_str(), &end);
+      valid = !value.empty() && *end == '\0' && options.annotatedShare >= 0 && options.annotatedShare <= 1;
+    }
+    else if (name == "--seed") {
+      valid = parseInt(value, 0, UINT32_MAX, number);
+      options.seed = number;
+    }
+    else {
+      std::cerr << "unknown option: " << arg << "\n";
+      return 1;
+    }
+    if (!valid) {
+      std::cerr << name << " takes " << (name == "--functions" ? "a positive number" :
+                                         name == "--annotated" ? "a share from 0 to 1" : "a non-negative number")
+                << ": " << value << "\n";
+      return 1;
+    }
+  }
+  std::cout << generateProgram(options);
+  return 0;
+}
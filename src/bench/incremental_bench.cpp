@@ -0,0 +1,185 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <iterator>
+#include <cstdio>
+
+#include <unistd.h>
+
+#include "../Lowering.h"
+#include "../Compilation.h"
+#include "../Incremental.h"
+#include "../Server.h"
+
+
+// Edits one function of a large generated file at a time and compares the
+// latency of a full compile against IncrementalCompiler, checking that
+// both produce the same C. Edits either keep the signature of the edited
+// function (only its body changes) or change its result type, which
+// pulls in its callers. Each run ends with sources no function has to
+// be recompiled for: the same text again, a reformatted one, one without
+// the last function, which nothing calls, and the last function back.
+// Before the runs, a CompileServer gets a whitespace-only edit.
+
+static std::string makeFunction(int index, int version, bool boolResult) {
+  std::ostringstream oss;
+  oss << "fn f" << index << "(int a, int b) {\n";
+  oss << "  let x = a * " << (index + version + 1) << " + b;\n";
+  if (index > 0) {
+    oss << "  let y = f" << (index * 7 + 3) % index << "(x, b);\n";
+  }
+  oss << "  if (x == " << (version + 1) << ") {\n";
+  oss << "    x = x - 1;\n";
+  oss << "  }\n";
+  oss << "  return " << (boolResult ? "x == b" : "x") << ";\n";
+  oss << "}\n";
+  return oss.str();
+}
+
+static std::string makeSource(const std::vector<int>& versions, const std::vector<bool>& boolResults,
+                              size_t functionCount) {
+  std::string source;
+  for (size_t i = 0; i < functionCount; i++) {
+    source += makeFunction(i, versions[i], boolResults[i]);
+  }
+  return source;
+}
+
+static std::string makeSource(const std::vector<int>& versions, const std::vector<bool>& boolResults) {
+  return makeSource(versions, boolResults, versions.size());
+}
+
+// every line indented once more and followed by a blank one
+static std::string reformat(const std::string& source) {
+  std::string text;
+  for (auto c : source) {
+    text += c;
+    if (c == '\n') {
+      text += "\n  ";
+    }
+  }
+  return text;
+}
+
+// C code of each ok reply in the server's output, or an error message
+static std::vector<std::string> okPayloads(const std::string& replies) {
+  std::vector<std::string> payloads;
+  size_t position = 0;
+  while (position < replies.size()) {
+    size_t newline = replies.find('\n', position);
+    std::istringstream header(replies.substr(position, newline - position));
+    std::string status, name;
+    size_t recompiled = 0, micros = 0, bytes = 0;
+    header >> status >> name;
+    if (status != "ok") {
+      payloads.push_back(replies.substr(position));
+      return payloads;
+    }
+    header >> recompiled >> micros >> bytes;
+    payloads.push_back(replies.substr(newline + 1, bytes));
+    position = newline + 1 + bytes;
+  }
+  return payloads;
+}
+
+// Opens source in a CompileServer, then inserts a newline at its start,
+// which has to reply with the same C.
+static bool checkServerLayoutEdit(const std::string& source) {
+  std::string requests = "open a " + std::to_string(source.size()) + "\n" + source + "edit a 0 0 1\n\nquit\n";
+  int in[2];
+  FILE *out = std::tmpfile();
+  if (pipe(in) != 0 || out == nullptr || requests.size() > 64 * 1024) {
+    std::cerr << "can't set up the server check\n";
+    return false;
+  }
+  // the requests fit in the pipe buffer, so one thread is enough
+  bool written = write(in[1], requests.data(), requests.size()) == static_cast<ssize_t>(requests.size());
+  close(in[1]);
+  CompileServer server;
+  server.serve(in[0], fileno(out));
+  close(in[0]);
+
+  std::string replies;
+  std::rewind(out);
+  char chunk[4096];
+  for (size_t n; (n = std::fread(chunk, 1, sizeof(chunk), out)) > 0;) {
+    replies.append(chunk, n);
+  }
+  std::fclose(out);
+
+  std::vector<std::string> payloads = okPayloads(replies);
+  if (!written || payloads.size() != 2 || payloads[0] != payloads[1]) {
+    std::cerr << "the server changed its output on a layout edit:\n" << replies.substr(0, 1000) << "\n";
+    return false;
+  }
+  return true;
+}
+
+template <typename F>
+static double timeMs(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, const char *argv[]) {
+  int edits = (argc > 1) ? std::atoi(argv[1]) : 20;
+
+  if (!checkServerLayoutEdit(makeSource(std::vector<int>(20, 0), std::vector<bool>(20, false)))) {
+    return 1;
+  }
+
+  std::cout << "functions\tfull(ms)\tincremental(ms)\tspeedup\trecompiled/edit\n";
+  for (int functionCount : { 100, 1000, 5000 }) {
+    std::mt19937 gen(functionCount);
+    std::vector<int> versions(functionCount, 0);
+    std::vector<bool> boolResults(functionCount, false);
+
+    IncrementalCompiler incremental;
+    std::string output, error;
+    incremental.compile(makeSource(versions, boolResults), output, error);
+
+    double fullTime = 0, incrementalTime = 0;
+    size_t recompiled = 0;
+    for (int e = 0; e < edits; e++) {
+      int target = gen() % functionCount;
+      versions[target]++;
+      // every fourth edit changes a result type; callers only pass it on, so they still check
+      if (e % 4 == 3) {
+        boolResults[target] = !boolResults[target];
+      }
+      std::string source = makeSource(versions, boolResults);
+
+      std::string fullOutput, incrementalOutput;
+      fullTime += timeMs([&] { compileSource(source, ParseOptions(), fullOutput, error); });
+      incrementalTime += timeMs([&] { incremental.compile(source, incrementalOutput, error); });
+      recompiled += incremental.recompiledCount();
+      if (fullOutput != incrementalOutput) {
+        std::cerr << "outputs differ after edit " << e << " of f" << target << "\n";
+        return 1;
+      }
+    }
+
+    // f<i> only calls functions before it, so the last one has no callers
+    std::string last = makeSource(versions, boolResults);
+    const char *steps[] = { "unchanged", "reformatted", "deleted", "re-added" };
+    std::string stepSources[] = { last, reformat(last), makeSource(versions, boolResults, functionCount - 1), last };
+    for (size_t s = 0; s < std::size(steps); s++) {
+      std::string fullOutput, incrementalOutput, fullError, incrementalError;
+      bool fullOk = compileSource(stepSources[s], ParseOptions(), fullOutput, fullError);
+      bool incrementalOk = incremental.compile(stepSources[s], incrementalOutput, incrementalError);
+      if (!fullOk || !incrementalOk || fullOutput != incrementalOutput) {
+        std::cerr << "outputs differ on the " << steps[s] << " source: " << incrementalError << "\n";
+        return 1;
+      }
+    }
+
+    std::cout << functionCount << "\t" << fullTime / edits << "\t" << incrementalTime / edits << "\t"
+              << fullTime / incrementalTime << "x\t" << double(recompiled) / edits << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,96 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+
+#include "../Interner.h"
+#include "../AST.h"
+#include "../Lowering.h"
+
+
+// Compares full-LL parsing against the two-stage SLL/LL mode on generated
+// sources dominated by long left-recursive expression chains, and reports
+// how often the two-stage mode had to fall back to full LL. The two-stage
+// mode is timed with both the generated and the hand-written lexer.
+
+static std::string makeExpr(std::mt19937& gen, int length) {
+  static const char *ops[] = { " + ", " - ", " * ", " / " };
+  std::ostringstream oss;
+  oss << "a";
+  for (int i = 0; i < length; i++) {
+    oss << ops[gen() % 4];
+    switch (gen() % 4) {
+      case 0: oss << (gen() % 1000 + 1); break;
+      case 1: oss << "(b - " << (gen() % 100 + 1) << ")"; break;
+      case 2: oss << "-a"; break;
+      default: oss << "b"; break;
+    }
+  }
+  return oss.str();
+}
+
+// one source of functionCount functions; broken sources miss a ';' in the last one
+static std::string makeSource(std::mt19937& gen, int functionCount, int exprLength, bool broken) {
+  std::ostringstream oss;
+  for (int f = 0; f < functionCount; f++) {
+    oss << "fn f" << f << "(int a, int b): int {\n";
+    oss << "  let x = " << makeExpr(gen, exprLength) << ";\n";
+    oss << "  if (x == " << makeExpr(gen, exprLength / 4) << ") {\n";
+    oss << "    x = " << makeExpr(gen, exprLength) << ";\n";
+    oss << "  }\n";
+    if (f > 0) {
+      oss << "  let y = f" << (f - 1) << "(x, b)" << ((broken && f + 1 == functionCount) ? "" : ";") << "\n";
+    }
+    oss << "  return x;\n";
+    oss << "}\n";
+  }
+  return oss.str();
+}
+
+static double timeParse(const std::vector<std::string>& sources, ParseMode mode, bool fastLexer, int& fallbacks) {
+  ParseOptions options;
+  options.mode = mode;
+  options.fastLexer = fastLexer;
+
+  fallbacks = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (auto& source : sources) {
+    Interner names;
+    ParseStats stats;
+    Ast ast = parseSource(source, names, options, &stats);
+    fallbacks += stats.fellBack;
+  }
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, const char *argv[]) {
+  int fileCount = (argc > 1) ? std::atoi(argv[1]) : 20;
+  int brokenEvery = (argc > 2) ? std::atoi(argv[2]) : 10;
+
+  std::cout << "functions\texpr length\tLL(ms)\ttwo-stage(ms)\tspeedup\tfallbacks\tfast lexer(ms)\tspeedup\n";
+  for (int functionCount : { 10, 100, 1000 }) {
+    for (int exprLength : { 8, 64 }) {
+      std::mt19937 gen(functionCount * 31 + exprLength);
+      std::vector<std::string> sources;
+      for (int i = 0; i < fileCount; i++) {
+        bool broken = brokenEvery > 0 && i % brokenEvery == brokenEvery - 1;
+        sources.push_back(makeSource(gen, functionCount, exprLength, broken));
+      }
+
+      int llFallbacks, twoStageFallbacks, fastLexerFallbacks;
+      // warm the shared DFA cache so neither mode pays for it alone
+      timeParse({ sources[0] }, ParseMode::LL, false, llFallbacks);
+      double llTime = timeParse(sources, ParseMode::LL, false, llFallbacks);
+      double twoStageTime = timeParse(sources, ParseMode::TwoStage, false, twoStageFallbacks);
+      double fastLexerTime = timeParse(sources, ParseMode::TwoStage, true, fastLexerFallbacks);
+
+      std::cout << functionCount << "\t" << exprLength << "\t" << llTime << "\t" << twoStageTime << "\t"
+                << llTime / twoStageTime << "x\t" << twoStageFallbacks << "/" << fileCount << "\t"
+                << fastLexerTime << "\t" << twoStageTime / fastLexerTime << "x\n";
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,96 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <cstdlib>
+
+#include "../Lowering.h"
+#include "../Compilation.h"
+#include "../PassStats.h"
+#include "ProgramGenerator.h"
+
+
+// Compiles generated programs at 10x, 100x and 1000x the default size and
+// times each phase on its own through the PassStats of the context, best
+// of a few runs. Time per AST node should stay flat as files grow; a phase
+// whose column climbs with the scale is superlinear.
+
+static const char *phases[] = { "lex", "parse", "symbol table", "type equations", "unify", "transpile" };
+
+static double phaseMillis(const PassStats& stats, const std::string& name) {
+  for (auto& phase : stats.phases) {
+    if (phase.name == name) {
+      return phase.millis;
+    }
+  }
+  return 0;
+}
+
+static uint64_t counter(const PassStats& stats, const std::string& name) {
+  for (auto& entry : stats.counters) {
+    if (entry.name == name) {
+      return entry.value;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  int runs = (argc > 1) ? std::atoi(argv[1]) : 3;
+  int maxScale = (argc > 2) ? std::atoi(argv[2]) : 1000;
+
+  std::cout << "scale\tfunctions\tnodes";
+  for (auto *phase : phases) {
+    std::cout << "\t" << phase << "(ms)";
+  }
+  std::cout << "\toptimize(ms)\ttotal(ms)\tns/node\n";
+
+  for (int scale = 10; scale <= maxScale; scale *= 10) {
+    GeneratorOptions options;
+    options.functions *= scale;
+    std::string source = generateProgram(options);
+
+    // best time of each phase over the runs; everything else is optimization
+    std::vector<double> best(std::size(phases) + 1, 1e300);
+    uint64_t nodes = 0;
+    for (int run = 0; run < runs; run++) {
+      PassStats stats;
+      CompilationContext context;
+      context.stats = &stats;
+      std::string error;
+      context.parse(source, ParseOptions());
+      if (!context.analyze(error)) {
+        std::cerr << error << " at " << scale << "x\n";
+        return 1;
+      }
+      if (!context.infer()) {
+        std::cerr << "Type inference failed at " << scale << "x\n";
+        return 1;
+      }
+      context.optimize();
+      context.transpile();
+
+      double rest = 0;
+      for (auto& phase : stats.phases) {
+        rest += phase.millis;
+      }
+      for (size_t i = 0; i < std::size(phases); i++) {
+        double millis = phaseMillis(stats, phases[i]);
+        best[i] = std::min(best[i], millis);
+        rest -= millis;
+      }
+      best.back() = std::min(best.back(), rest);
+      nodes = counter(stats, "AST nodes");
+    }
+
+    double total = 0;
+    std::cout << scale << "x\t" << options.functions << "\t" << nodes;
+    for (auto millis : best) {
+      std::cout << "\t" << millis;
+      total += millis;
+    }
+    std::cout << "\t" << total << "\t" << total * 1e6 / nodes << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,57 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include "../Type.h"
+#include "../HMTypeInference.h"
+
+
+// Builds an equation set shaped like the output of TypeEquationGenerater
+// (chains of expression vars, call sites unified against function types)
+// and reports how unifyAllEquations scales with the number of equations.
+static std::vector<TypeEquation> makeEquations(TypeContext& types, int varCount) {
+  std::vector<TypeEquation> equations;
+  std::vector<TypeVar*> vars;
+  auto *intType = types.intType();
+
+  for (int i = 0; i < varCount; i++) {
+    vars.push_back(types.addTypeVar());
+    if (i == 0) {
+      continue;
+    }
+    // binary expressions tie a node to both of its operands
+    equations.push_back(TypeEquation{ vars[i], vars[i / 2] });
+    equations.push_back(TypeEquation{ vars[i], vars[i - 1] });
+
+    if (i % 8 == 0) {
+      auto *callee = types.getFunctionType({ intType }, vars[i - 3]);
+      auto *callSite = types.getFunctionType({ vars[i - 5] }, types.addTypeVar());
+      equations.push_back(TypeEquation{ callee, callSite });
+    }
+  }
+  equations.push_back(TypeEquation{ vars.back(), intType });
+  return equations;
+}
+
+int main(int argc, const char *argv[]) {
+  int maxVars = (argc > 1) ? std::atoi(argv[1]) : 1000000;
+
+  std::cout << "vars\tequations\ttotal(ms)\tper equation(ns)\n";
+  for (int varCount = 1000; varCount <= maxVars; varCount *= 10) {
+    TypeContext types;
+    auto equations = makeEquations(types, varCount);
+
+    auto start = std::chrono::steady_clock::now();
+    auto subst = unifyAllEquations(equations);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    if (!subst.has_value()) {
+      std::cout << "unification failed at " << varCount << " vars\n";
+      return 1;
+    }
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    std::cout << varCount << "\t" << equations.size() << "\t" << ns / 1e6 << "\t" << ns / equations.size() << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,169 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "../Lowering.h"
+#include "../Compilation.h"
+#include "../Bytecode.h"
+#include "../VM.h"
+#include "../JIT.h"
+
+
+// Runs small programs on the bytecode VM, as JIT code, and through the
+// transpile and compile path (C from the Transpiler built with the system
+// cc), and reports the time to a result for each. The VM and JIT sides
+// include every compiler phase; the C side splits the cc run from the
+// program run. Last, the rate of short calls through a JIT entry pointer.
+
+static const char *source =
+  "fn fib(int n): int {\n"
+  "  if (n == 1) {\n"
+  "    return 1;\n"
+  "  }\n"
+  "  if (n == 2) {\n"
+  "    return 1;\n"
+  "  }\n"
+  "  return fib(n - 1) + fib(n - 2);\n"
+  "}\n"
+  "fn step(int x, int n): int {\n"
+  "  if (n == 1) {\n"
+  "    return x;\n"
+  "  }\n"
+  "  let y = x * 31 + n / 3 - 7;\n"
+  "  if (y / 2 * 2 == y) {\n"
+  "    y = -y;\n"
+  "  }\n"
+  "  return step(y, n - 1);\n"
+  "}\n";
+
+struct Workload {
+  const char *function;
+  std::vector<int64_t> args;
+};
+
+static double millisSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double timeCommand(const std::string& command) {
+  auto start = std::chrono::steady_clock::now();
+  if (std::system(command.c_str()) != 0) {
+    return -1;
+  }
+  return millisSince(start);
+}
+
+int main() {
+  std::vector<Workload> workloads = {
+    { "fib", { 20 } },
+    { "fib", { 27 } },
+    { "step", { 7, 1000 } },
+    { "step", { 7, 100000 } },
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  CompilationContext context;
+  std::string error;
+  context.parse(source, ParseOptions());
+  if (!context.analyze(error)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  if (!context.infer()) {
+    std::cerr << "Type inference failed...\n";
+    return 1;
+  }
+  double frontTime = millisSince(start);
+
+  start = std::chrono::steady_clock::now();
+  BytecodeProgram program;
+  if (!compileBytecode(context, program, error)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  double bytecodeTime = millisSince(start);
+
+  start = std::chrono::steady_clock::now();
+  JitProgram jit;
+  if (!jit.compile(program, error)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  double jitTime = millisSince(start);
+  std::string code = context.transpile();
+
+  char dir[] = "/tmp/tmplang_vm_bench.XXXXXX";
+  if (mkdtemp(dir) == nullptr) {
+    std::cerr << "can't make a temporary directory\n";
+    return 1;
+  }
+
+  std::cout << "front end " << frontTime << " ms, bytecode " << bytecodeTime << " ms, jit " << jitTime << " ms ("
+            << jit.codeSize() << " bytes)\n";
+  std::cout << "call\tresult\tvm run(ms)\tvm total(ms)\tjit run(ms)\tjit total(ms)\tcc -O0(ms)\trun(ms)\tcc -O2(ms)\trun(ms)\tC total -O2(ms)\n";
+  for (auto& workload : workloads) {
+    std::ostringstream call;
+    call << workload.function << "(";
+    for (size_t i = 0; i < workload.args.size(); i++) {
+      call << (i ? ", " : "") << workload.args[i];
+    }
+    call << ")";
+
+    VirtualMachine vm(program);
+    int64_t result;
+    start = std::chrono::steady_clock::now();
+    if (!vm.call(workload.function, workload.args, result, error)) {
+      std::cerr << error << "\n";
+      return 1;
+    }
+    double vmTime = millisSince(start);
+
+    int64_t jitResult;
+    start = std::chrono::steady_clock::now();
+    if (!jit.call(program.findFunction(workload.function), workload.args, jitResult, error) || jitResult != result) {
+      std::cerr << "JIT run of " << workload.function << " failed: " << error << "\n";
+      return 1;
+    }
+    double jitRunTime = millisSince(start);
+
+    // the transpiled C wrapped in a main that prints the same call
+    std::string cPath = std::string(dir) + "/program.c";
+    std::ofstream out(cPath);
+    out << "#include <stdio.h>\n#include <stdbool.h>\n" << code
+        << "int main(void) { printf(\"%d\\n\", " << call.str() << "); return 0; }\n";
+    out.close();
+
+    double ccTime[2], runTime[2];
+    const char *levels[2] = { "-O0", "-O2" };
+    for (int i = 0; i < 2; i++) {
+      std::string binary = std::string(dir) + "/program" + levels[i];
+      ccTime[i] = timeCommand(std::string("cc -w -fwrapv ") + levels[i] + " -o " + binary + " " + cPath);
+      runTime[i] = (ccTime[i] < 0) ? -1 : timeCommand(binary + " > /dev/null");
+    }
+
+    std::cout << call.str() << "\t" << result << "\t" << vmTime << "\t" << frontTime + bytecodeTime + vmTime << "\t"
+              << jitRunTime << "\t" << frontTime + bytecodeTime + jitTime + jitRunTime << "\t"
+              << ccTime[0] << "\t" << runTime[0] << "\t" << ccTime[1] << "\t" << runTime[1] << "\t"
+              << frontTime + ccTime[1] + runTime[1] << "\n";
+  }
+
+  std::system((std::string("rm -rf ") + dir).c_str());
+
+  // step(x, 2) straight through the entry pointer, as a host would
+  auto step = reinterpret_cast<int64_t(*)(int64_t, int64_t)>(jit.entry(program.findFunction("step")));
+  const int calls = 10000000;
+  int64_t sum = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < calls; i++) {
+    sum += step(i, 2);
+  }
+  double callTime = millisSince(start);
+  std::cout << "step(x, 2) through the JIT entry: " << calls / callTime / 1000 << " M calls/s (sum " << sum << ")\n";
+  return 0;
+}
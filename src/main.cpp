@@ -2,311 +2,658 @@
 #include <string>
 #include <vector>
 #include <utility>
-#include <random>
 #include <unordered_map>
 #include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <charconv>
+#include <cerrno>
+#include <cstdint>
 
-#include "antlr4-runtime.h"
-#include "TmplangLexer.h"
-#include "TmplangParser.h"
-#include "TmplangBaseListener.h"
-#include "TmplangBaseVisitor.h"
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "Type.h"
+#include "Interner.h"
+#include "AST.h"
+#include "Lowering.h"
+#include "SourceBuffer.h"
 #include "SymbolTable.h"
 #include "HMTypeInference.h"
-#include "Transpiler.h"
-
-using namespace antlr4;
-
-
-class TypeEquationGenerater : public TmplangBaseListener {
+#include "Compilation.h"
+#include "ThreadPool.h"
+#include "CompileCache.h"
+#include "Server.h"
+#include "CodeWriter.h"
+#include "Bytecode.h"
+#include "VM.h"
+#include "JIT.h"
+#include "PassStats.h"
+
+
+// Writes the inferred type of every function, parameter and local, in
+// source order, to out.
+class Checker {
  public:
-  TypeEquationGenerater(tree::ParseTreeProperty<std::shared_ptr<Scope>>& _scopes) : scopes(_scopes) {}
-
-  tree::ParseTreeProperty<std::shared_ptr<Scope>>& scopes;
-  Scope *currentScope;
-  Type *currentFunctionType;
-
-  tree::ParseTreeProperty<Type*> nodeTypes;
-  std::vector<TypeEquation> equations;
-
-  void enterFile(TmplangParser::FileContext *ctx) override {
-    currentScope = scopes.get(ctx).get();
-  }
-
-  void enterFunction(TmplangParser::FunctionContext *ctx) override {
-    currentFunctionType = currentScope->symbols.find(ctx->identifier()->getText())->second;
-
-    Type *returnType;
-    if (ctx->functionReturnTypeDecl() != nullptr) {
-      returnType = addConcreteType(ctx->functionReturnTypeDecl()->type()->getText());
-    }
-    else {
-      returnType = addTypeVar();
+  Checker(const Ast& _ast, ScopeMap& _scopes, ScopeTable& _scopeTable, const Interner& _names, std::ostream& _out)
+    : ast(_ast), scopes(_scopes), scopeTable(_scopeTable), names(_names), out(_out) {}
+
+  const Ast& ast;
+  ScopeMap& scopes;
+  ScopeTable& scopeTable;
+  const Interner& names;
+  std::ostream& out;
+  ScopeId currentScope;
+
+  void visit(NodeId node) {
+    const Node& n = ast[node];
+    switch (n.kind) {
+      case NodeKind::File:
+        currentScope = scopes[node];
+        for (auto func : ast.list(node)) {
+          visit(func);
+        }
+        break;
+
+      case NodeKind::Function:
+        printInferredType(n.name);
+        currentScope = scopes[node];
+        for (auto param : ast.list(node)) {
+          printInferredType(ast[param].name);
+        }
+        visit(n.operands[0]);
+        currentScope = scopeTable[currentScope].parent;
+        break;
+
+      case NodeKind::Block:
+        currentScope = scopes[node];
+        for (auto stmt : ast.list(node)) {
+          visit(stmt);
+        }
+        currentScope = scopeTable[currentScope].parent;
+        break;
+
+      case NodeKind::If:
+        currentScope = scopes[node];
+        visit(n.operands[1]);
+        if (n.operands[2] != NoNode) {
+          visit(n.operands[2]);
+        }
+        currentScope = scopeTable[currentScope].parent;
+        break;
+
+      case NodeKind::VarDecl:
+        printInferredType(n.name);
+        break;
+
+      default:
+        break;
     }
-    dynamic_cast<FunctionType*>(currentFunctionType)->to = returnType;
-
-    currentScope = scopes.get(ctx).get();
-    currentFunctionType = currentScope->parent->symbols.find(ctx->identifier()->getText())->second;
   }
 
-  void exitFunction(TmplangParser::FunctionContext *ctx) override {
-    currentScope = currentScope->parent;
-  }
-
-  void enterBlockStatement(TmplangParser::BlockStatementContext *ctx) override {
-    currentScope = scopes.get(ctx).get();
+ private:
+  void printInferredType(SymbolId name) {
+    Type *varType = scopeTable.resolve(currentScope, name);
+    Type *inferredType = varType->resolved();
+    out << names.name(name) << ": ";
+    inferredType->print(out);
+    out << "\n";
   }
+};
 
-  void exitBlockStatement(TmplangParser::BlockStatementContext *ctx) override {
-    currentScope = currentScope->parent;
-  }
 
-  void enterIfStatement(TmplangParser::IfStatementContext *ctx) override {
-    currentScope = scopes.get(ctx).get();
-  }
+// what the driver writes for each input
+enum class EmitKind {
+  C,
+  // inferred type of every variable
+  Types,
+  // inferred signature of every function, which the cache also keeps
+  Signatures,
+  // type equations, before they are solved
+  Equations,
+  // all of the above with the substitution found by inference, for debugging
+  Trace,
+};
 
-  void exitIfStatement(TmplangParser::IfStatementContext *ctx) override {
-    Type *ifResultType = addConcreteType("bool");
+struct DriverOptions {
+  ParseOptions parse;
+  EmitKind emit = EmitKind::C;
+  bool staticInline = false;
+};
 
-    equations.push_back(TypeEquation{ nodeTypes.get(ctx->expr()), ifResultType });
-    currentScope = currentScope->parent;
+static const char* emitExtension(EmitKind kind) {
+  switch (kind) {
+    case EmitKind::C: return ".c";
+    case EmitKind::Types: return ".types";
+    case EmitKind::Signatures: return ".signatures";
+    case EmitKind::Equations: return ".equations";
+    case EmitKind::Trace: return ".trace";
   }
+  return "";
+}
 
-  void exitVarDeclStatement(TmplangParser::VarDeclStatementContext *ctx) override {
-    if (ctx->expr() == nullptr) {
-      return;
-    }
-
-    Type *identifierType = currentScope->resolve(ctx->identifier()->getText());
-    if (identifierType == nullptr) {
-      std::cout << "can't find identifier definition!!\n";
+static void printEquations(CompilationContext& context, std::ostream& out) {
+  for (auto& function : context.functions) {
+    for (auto& eq : function.equations) {
+      out << "equation ===========\n";
+      eq.left->print(out);
+      out << "  ==  ";
+      eq.right->print(out);
+      out << '\n';
     }
-
-    equations.push_back(TypeEquation{ identifierType, nodeTypes.get(ctx->expr()) });
   }
+}
 
-  void exitReturnStatement(TmplangParser::ReturnStatementContext *ctx) override {
-    Type* a = nodeTypes.get(ctx->expr());
-    Type* b = dynamic_cast<FunctionType*>(currentFunctionType)->to;
-    equations.push_back(TypeEquation{ a, b });
-  }
+static void printTypes(CompilationContext& context, std::ostream& out) {
+  PhaseTimer timer(context.stats, "check");
+  Checker checker(context.ast, context.scopes, context.scopeTable, context.names, out);
+  checker.visit(context.ast.root);
+}
 
-  void exitAssignStatement(TmplangParser::AssignStatementContext *ctx) override {
-    Type *identifierType = currentScope->resolve(ctx->identifier()->getText());
-    if (identifierType == nullptr) {
-      std::cout << "can't find identifier definition!!\n";
+// Runs only the phases the output of options.emit needs over source and
+// writes it to sink: equations stop after analysis, types and signatures
+// after inference, and only C is optimized. Returns a message, empty on
+// success. When a cache is given, C and signatures are served from it, and
+// a compile to C stores both.
+static std::string emitSource(std::string_view source, const DriverOptions& options, ThreadPool *pool,
+                              CompileCache *cache, PassStats *stats, OutputSink& sink) {
+  CompilationContext context;
+  context.staticInlineHelpers = options.staticInline;
+  context.stats = stats;
+
+  CachedCompile result;
+  bool cacheable = (options.emit == EmitKind::C || options.emit == EmitKind::Signatures);
+  bool cached = cacheable && cache != nullptr && cache->lookup(source, result);
+  if (stats != nullptr && cacheable) {
+    stats->count("cached files", cached);
+  }
+  if (cached) {
+    sink.flush((options.emit == EmitKind::C) ? result.output : result.signatures);
+    return "";
+  }
+
+  if (!context.parse(source, options.parse)) {
+    return "Syntax errors...";
+  }
+  std::string error;
+  if (!context.analyze(error)) {
+    return error;
+  }
+  std::ostringstream text;
+  if (options.emit == EmitKind::Equations || options.emit == EmitKind::Trace) {
+    printEquations(context, text);
+  }
+  if (options.emit == EmitKind::Equations) {
+    std::string equations = text.str();
+    sink.flush(equations);
+    return "";
+  }
+
+  bool inferred = context.infer(pool);
+  if (options.emit == EmitKind::Trace) {
+    if (!inferred) {
+      text << "Type inference failed...\n";
+      std::string trace = text.str();
+      sink.flush(trace);
+      return "";
     }
-
-    equations.push_back(TypeEquation{ identifierType, nodeTypes.get(ctx->expr()) });
+    text << "Type inference succeeded!!\n";
+    for (auto *typeVar : context.types.allTypeVars()) {
+      if (typeVar->resolved() == typeVar) continue;
+      text << "Type var id: " << typeVar->id << " -> ";
+      typeVar->resolved()->print(text);
+      text << "\n";
+    }
+    text << "---------------------------\n";
+    text << "Type inference result\n";
+  }
+  if (!inferred) {
+    return "Type inference failed...";
+  }
+  if (options.emit == EmitKind::Signatures) {
+    // a miss is not stored, since an entry needs the C too
+    std::string signatures = context.signatures();
+    sink.flush(signatures);
+    return "";
+  }
+  if (options.emit != EmitKind::C) {
+    printTypes(context, text);
+    if (options.emit == EmitKind::Types) {
+      std::string types = text.str();
+      sink.flush(types);
+      return "";
+    }
+    text << "\n";
   }
 
-  void enterFunctionCallExpr(TmplangParser::FunctionCallExprContext *ctx) override {
-    nodeTypes.put(ctx, addTypeVar());
+  context.optimize();
+  if (options.emit == EmitKind::Trace) {
+    text << "transpiled result: \n\n";
+    std::string trace = text.str();
+    sink.write(trace);
+  }
+  if (cache == nullptr || options.emit != EmitKind::C) {
+    // nothing keeps the code, so it goes straight to the sink
+    context.transpile(sink);
+    return "";
   }
+  result.signatures = context.signatures();
+  result.output = context.transpile();
+  cache->store(source, result);
+  sink.flush(result.output);
+  return "";
+}
 
-  void exitFunctionCallExpr(TmplangParser::FunctionCallExprContext *ctx) override {
-    auto *functionType = addFunctionType();
 
-    if (ctx->exprList() != nullptr) {
-      for (auto *arg : ctx->exprList()->expr()) {
-        functionType->from.push_back(nodeTypes.get(arg));
+// Compiles every input file on a thread pool, to output when it is set
+// (only for one input) and else to <input> with the extension of the emit
+// kind. Messages are printed in input order at the end. With stats, the
+// phases of all files are added to it.
+static int compileBatch(const std::vector<std::string>& inputs, const std::string& output, const DriverOptions& options,
+                        unsigned jobs, CompileCache *cache, PassStats *stats) {
+  std::vector<std::string> errors(inputs.size());
+  std::vector<PassStats> fileStats(inputs.size());
+
+  ThreadPool pool(jobs);
+  for (size_t i = 0; i < inputs.size(); i++) {
+    pool.submit([&, i] {
+      SourceBuffer source;
+      if (!source.load(inputs[i])) {
+        errors[i] = "can't read the input";
+        return;
       }
-    }
-    functionType->to = nodeTypes.get(ctx);
-
-    equations.push_back(TypeEquation{ nodeTypes.get(ctx->expr()), functionType });
+      std::string path = output.empty() ? inputs[i] + emitExtension(options.emit) : output;
+      int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (fd < 0) {
+        errors[i] = "can't write the output";
+        return;
+      }
+      FdSink sink(fd);
+      errors[i] = emitSource(source.text(), options, &pool, cache, (stats != nullptr) ? &fileStats[i] : nullptr, sink);
+      bool failed = sink.failed();
+      if (close(fd) != 0 || (failed && errors[i].empty())) {
+        errors[i] = "can't write the output";
+      }
+      if (!errors[i].empty()) {
+        unlink(path.c_str());
+      }
+    });
   }
-
-  void enterNegateExpr(TmplangParser::NegateExprContext *ctx) override {
-    nodeTypes.put(ctx, addTypeVar());
+  pool.wait();
+  if (stats != nullptr) {
+    for (auto& file : fileStats) {
+      stats->merge(file);
+    }
   }
 
-  void exitNegateExpr(TmplangParser::NegateExprContext *ctx) override {
-    equations.push_back(TypeEquation{ nodeTypes.get(ctx), nodeTypes.get(ctx->expr()) });
+  int failed = 0;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (!errors[i].empty()) {
+      std::cerr << inputs[i] << ": " << errors[i] << "\n";
+      failed++;
+    }
   }
+  std::cerr << inputs.size() - failed << "/" << inputs.size() << " files compiled\n";
+  return (failed == 0) ? 0 : 1;
+}
 
-  void enterNotExpr(TmplangParser::NotExprContext *ctx) override {
-    nodeTypes.put(ctx, addTypeVar());
-  }
+static void printCacheStats(CompileCache& cache) {
+  CacheStats stats = cache.stats();
+  uint64_t lookups = stats.hits + stats.misses;
+  std::cout << "cache directory: " << cache.directory << "\n";
+  std::cout << "entries: " << stats.entries << " (" << stats.bytes / 1024 << " KB of "
+            << cache.maxBytes / (1024 * 1024) << " MB)\n";
+  std::cout << "hits: " << stats.hits << ", misses: " << stats.misses << ", hit rate: " << std::fixed << std::setprecision(1)
+            << ((lookups == 0) ? 0.0 : 100.0 * stats.hits / lookups) << "%\n";
+}
 
-  void exitNotExpr(TmplangParser::NotExprContext *ctx) override {
-    equations.push_back(TypeEquation{ nodeTypes.get(ctx), nodeTypes.get(ctx->expr()) });
-  }
+// value of an option that counts something: a whole number from 1 to max
+static bool parseCount(const std::string& text, uint64_t max, uint64_t& value) {
+  auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+  return result.ec == std::errc() && result.ptr == text.data() + text.size() && value >= 1 && value <= max;
+}
 
-  void enterMulDivExpr(TmplangParser::MulDivExprContext *ctx) override {
-    nodeTypes.put(ctx, addTypeVar());
+// value of an argument given on the command line, read as kind
+static bool parseValue(const std::string& text, PrimitiveKind kind, int64_t& value) {
+  switch (kind) {
+    case PrimitiveKind::Bool:
+      value = (text == "true");
+      return text == "true" || text == "false";
+    case PrimitiveKind::Char:
+      if (text.size() == 3 && text.front() == '\'' && text.back() == '\'') {
+        value = text[1];
+        return true;
+      }
+      value = text.empty() ? 0 : text[0];
+      return text.size() == 1;
+    default: {
+      // an int argument must fit a C int, as the VM and the JIT compare all 64 bits
+      char *end;
+      errno = 0;
+      value = strtoll(text.c_str(), &end, 0);
+      return !text.empty() && *end == '\0' && errno != ERANGE && value >= INT32_MIN && value <= INT32_MAX;
+    }
   }
+}
 
-  void exitMulDivExpr(TmplangParser::MulDivExprContext *ctx) override {
-    equations.push_back(TypeEquation{ nodeTypes.get(ctx), nodeTypes.get(ctx->expr()[0]) });
-    equations.push_back(TypeEquation{ nodeTypes.get(ctx), nodeTypes.get(ctx->expr()[1]) });
+static void printValue(int64_t value, PrimitiveKind kind) {
+  switch (kind) {
+    case PrimitiveKind::Bool:
+      std::cout << (value ? "true" : "false") << "\n";
+      break;
+    case PrimitiveKind::Char:
+      std::cout << "'" << static_cast<char>(value) << "'\n";
+      break;
+    default:
+      std::cout << value << "\n";
+      break;
   }
+}
 
-  void enterPlusMinusExpr(TmplangParser::PlusMinusExprContext *ctx) override {
-    nodeTypes.put(ctx, addTypeVar());
+// Runs NAME[:ARG,...] of source on the bytecode VM, or as native code with
+// jit, and prints the result.
+static int runFunction(std::string_view source, const std::string& spec, const ParseOptions& parseOptions, bool jit,
+                       PassStats *stats) {
+  size_t colon = spec.find(':');
+  std::string name = spec.substr(0, colon);
+  std::vector<std::string> argTexts;
+  if (colon != std::string::npos) {
+    std::istringstream fields(spec.substr(colon + 1));
+    std::string field;
+    while (std::getline(fields, field, ',')) {
+      argTexts.push_back(field);
+    }
   }
 
-  void exitPlusMinusExpr(TmplangParser::PlusMinusExprContext *ctx) override {
-    equations.push_back(TypeEquation{ nodeTypes.get(ctx), nodeTypes.get(ctx->expr()[0]) });
-    equations.push_back(TypeEquation{ nodeTypes.get(ctx), nodeTypes.get(ctx->expr()[1]) });
+  CompilationContext context;
+  context.stats = stats;
+  if (!context.parse(source, parseOptions)) {
+    std::cerr << "Syntax errors...\n";
+    return 1;
+  }
+  std::string error;
+  if (!context.analyze(error)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  if (!context.infer()) {
+    std::cerr << "Type inference failed...\n";
+    return 1;
+  }
+  context.optimize();
+  BytecodeProgram program;
+  bool compiled;
+  {
+    PhaseTimer timer(stats, "bytecode");
+    compiled = compileBytecode(context, program, error);
+  }
+  if (!compiled) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  uint32_t function = program.findFunction(name);
+  if (function == NoFunction) {
+    std::cerr << "no function named " << name << "\n";
+    return 1;
+  }
+
+  const BytecodeFunction& callee = program.functions[function];
+  if (argTexts.size() != callee.params.size()) {
+    std::cerr << name << " takes " << callee.params.size() << " arguments\n";
+    return 1;
+  }
+  std::vector<int64_t> args(argTexts.size());
+  for (size_t i = 0; i < args.size(); i++) {
+    if (!parseValue(argTexts[i], callee.params[i], args[i])) {
+      std::cerr << "bad argument: " << argTexts[i] << "\n";
+      return 1;
+    }
   }
 
-  void enterEqualExpr(TmplangParser::EqualExprContext *ctx) override {
-    nodeTypes.put(ctx, addTypeVar());
+  int64_t result;
+  bool ok;
+  if (jit) {
+    JitProgram native;
+    {
+      PhaseTimer timer(stats, "jit");
+      ok = native.compile(program, error);
+    }
+    ok = ok && native.call(function, args, result, error);
   }
-
-  void exitEqualExpr(TmplangParser::EqualExprContext *ctx) override {
-    auto *equalResultType = addConcreteType("bool");
-
-    equations.push_back(TypeEquation{ nodeTypes.get(ctx->expr()[0]), nodeTypes.get(ctx->expr()[1]) });
-    equations.push_back(TypeEquation{ nodeTypes.get(ctx), equalResultType });
+  else {
+    VirtualMachine vm(program);
+    ok = vm.call(function, args, result, error);
   }
-
-  void enterVarRefExpr(TmplangParser::VarRefExprContext *ctx) override {
-    nodeTypes.put(ctx, addTypeVar());
+  if (!ok) {
+    std::cerr << error << "\n";
+    return 1;
   }
+  printValue(result, callee.result);
+  return 0;
+}
 
-  void exitVarRefExpr(TmplangParser::VarRefExprContext *ctx) override {
-    Type *varType = currentScope->resolve(ctx->identifier()->getText());
-    if (varType == nullptr) {
-      std::cout << "can't find variable definition!!! : " << ctx->identifier()->getText() << "\n";
+int main(int argc, const char *argv[]) {
+  DriverOptions options;
+  std::vector<std::string> inputs;
+  std::string output;
+  bool emitGiven = false;
+  unsigned jobs = 0;
+  bool useCache = true;
+  bool serveStdio = false;
+  bool watch = false;
+  std::string socketPath;
+  std::string runSpec;
+  bool jit = false;
+  bool cacheStats = false;
+  bool timePasses = false;
+  bool timePassesJson = false;
+  std::string cacheDirectory = CompileCache::defaultDirectory();
+  uint64_t cacheMegabytes = 256;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--parse-mode=ll") {
+      options.parse.mode = ParseMode::LL;
     }
-
-    equations.push_back(TypeEquation{ nodeTypes.get(ctx), varType });
-  }
-
-  void enterLiteralExpr(TmplangParser::LiteralExprContext *ctx) override {
-    if (ctx->literal()->IntegerLiteral() != nullptr) {
-      nodeTypes.put(ctx, addConcreteType("int"));
+    else if (arg == "--parse-mode=sll") {
+      options.parse.mode = ParseMode::SLL;
+    }
+    else if (arg == "--parse-mode=two-stage") {
+      options.parse.mode = ParseMode::TwoStage;
     }
-    else if (ctx->literal()->BoolLiteral() != nullptr) {
-      nodeTypes.put(ctx, addConcreteType("bool"));
+    else if (arg == "--lexer=fast") {
+      options.parse.fastLexer = true;
     }
-    else if (ctx->literal()->CharacterLiteral() != nullptr) {
-      nodeTypes.put(ctx, addConcreteType("char"));
+    else if (arg == "--lexer=antlr") {
+      options.parse.fastLexer = false;
+    }
+    else if (arg.compare(0, 7, "--jobs=") == 0) {
+      uint64_t value;
+      if (!parseCount(arg.substr(7), 1024, value)) {
+        std::cerr << "--jobs takes a number of threads from 1 to 1024: " << arg.substr(7) << "\n";
+        return 1;
+      }
+      jobs = value;
+    }
+    else if (arg == "--server") {
+      serveStdio = true;
+    }
+    else if (arg.compare(0, 9, "--server=") == 0) {
+      socketPath = arg.substr(9);
+    }
+    else if (arg.compare(0, 6, "--run=") == 0) {
+      runSpec = arg.substr(6);
+    }
+    else if (arg == "--jit") {
+      jit = true;
+    }
+    else if (arg == "--static-inline") {
+      options.staticInline = true;
+    }
+    else if (arg.compare(0, 7, "--emit=") == 0) {
+      std::string kind = arg.substr(7);
+      if (kind == "c") {
+        options.emit = EmitKind::C;
+      }
+      else if (kind == "types") {
+        options.emit = EmitKind::Types;
+      }
+      else if (kind == "signatures") {
+        options.emit = EmitKind::Signatures;
+      }
+      else if (kind == "equations") {
+        options.emit = EmitKind::Equations;
+      }
+      else if (kind == "trace") {
+        options.emit = EmitKind::Trace;
+      }
+      else {
+        std::cerr << "unknown output kind: " << kind << "\n";
+        return 1;
+      }
+      emitGiven = true;
+    }
+    else if (arg == "-o") {
+      if (i + 1 == argc) {
+        std::cerr << "-o needs a file name\n";
+        return 1;
+      }
+      output = argv[++i];
+    }
+    else if (arg.compare(0, 9, "--output=") == 0) {
+      output = arg.substr(9);
+    }
+    else if (arg == "--time-passes") {
+      timePasses = true;
+    }
+    else if (arg == "--time-passes=json") {
+      timePasses = true;
+      timePassesJson = true;
+    }
+    else if (arg == "--watch") {
+      watch = true;
+    }
+    else if (arg == "--no-cache") {
+      useCache = false;
+    }
+    else if (arg == "--cache-stats") {
+      cacheStats = true;
+    }
+    else if (arg.compare(0, 12, "--cache-dir=") == 0) {
+      cacheDirectory = arg.substr(12);
+    }
+    else if (arg.compare(0, 13, "--cache-size=") == 0) {
+      // megabytes, which must still fit in bytes
+      if (!parseCount(arg.substr(13), UINT64_MAX / (1024 * 1024), cacheMegabytes)) {
+        std::cerr << "--cache-size takes a positive number of megabytes: " << arg.substr(13) << "\n";
+        return 1;
+      }
+    }
+    else if (arg.compare(0, 2, "--") == 0) {
+      std::cerr << "unknown option: " << arg << "\n";
+      return 1;
     }
     else {
-      std::cout << "unparsable literal!!\n";
+      inputs.push_back(arg);
     }
   }
 
-  void enterParenExpr(TmplangParser::ParenExprContext *ctx) override {
-    nodeTypes.put(ctx, addTypeVar());
-  }
+  // reports go to stderr, which leaves stdout to the output of each mode
+  PassStats passStats;
+  PassStats *stats = timePasses ? &passStats : nullptr;
+  auto reportPasses = [&] {
+    if (timePasses) {
+      std::cerr << passStats.report(timePassesJson);
+    }
+  };
 
-  void exitParenExpr(TmplangParser::ParenExprContext *ctx) override {
-    equations.push_back(TypeEquation{ nodeTypes.get(ctx), nodeTypes.get(ctx->expr()) });
+  if (timePasses && (serveStdio || !socketPath.empty() || watch)) {
+    std::cerr << "--time-passes can't be used with --server or --watch\n";
+    return 1;
   }
-};
-
-
-
-class Checker : public TmplangBaseListener {
- public:
-  Checker(tree::ParseTreeProperty<std::shared_ptr<Scope>>& _scopes, std::unordered_map<int, Type*> _subst) : scopes(_scopes), subst(_subst) {}
-
-  tree::ParseTreeProperty<std::shared_ptr<Scope>>& scopes;
-  Scope *currentScope;
-  std::unordered_map<int, Type*> subst;
-
-  void enterFile(TmplangParser::FileContext *ctx) override {
-    currentScope = scopes.get(ctx).get();
+  if ((emitGiven || !output.empty()) && (!runSpec.empty() || serveStdio || !socketPath.empty() || watch)) {
+    std::cerr << "--emit and -o only apply to compiling files\n";
+    return 1;
   }
-
-  void enterFunction(TmplangParser::FunctionContext *ctx) override {
-    Type *varType = currentScope->resolve(ctx->identifier()->getText());
-    Type *inferredType = applyUnifier(varType, subst);
-    std::cout << ctx->identifier()->getText() << ": ";
-    inferredType->print();
-    std::cout << "\n";
-
-    currentScope = scopes.get(ctx).get();
+  if (!output.empty() && inputs.size() > 1) {
+    std::cerr << "-o takes one input file or stdin\n";
+    return 1;
   }
-
-  void enterFunctionParamDecl(TmplangParser::FunctionParamDeclContext *ctx) override {
-    Type *varType = currentScope->resolve(ctx->identifier()->getText());
-    Type *inferredType = applyUnifier(varType, subst);
-    std::cout << ctx->identifier()->getText() << ": ";
-    inferredType->print();
-    std::cout << "\n";
+  if (!runSpec.empty()) {
+    if (inputs.size() > 1) {
+      std::cerr << "--run takes one input file or stdin\n";
+      return 1;
+    }
+    SourceBuffer source;
+    if (!(inputs.empty() ? source.loadFd(0) : source.load(inputs[0]))) {
+      std::cerr << "can't read the input\n";
+      return 1;
+    }
+    int status = runFunction(source.text(), runSpec, options.parse, jit, stats);
+    reportPasses();
+    return status;
+  }
+  if (serveStdio || !socketPath.empty()) {
+    CompileServer server(options.parse);
+    if (serveStdio) {
+      // replies own stdout; messages printed by the phases go to stderr
+      int out = dup(1);
+      dup2(2, 1);
+      server.serve(0, out);
+      return 0;
+    }
+    return server.listen(socketPath) ? 0 : 1;
   }
-
-  void exitFunction(TmplangParser::FunctionContext *ctx) override {
-    currentScope = currentScope->parent;
+  if (watch) {
+    if (inputs.empty()) {
+      std::cerr << "--watch needs input files\n";
+      return 1;
+    }
+    CompileServer server(options.parse);
+    return server.watch(inputs) ? 0 : 1;
   }
 
-  void enterBlockStatement(TmplangParser::BlockStatementContext *ctx) override {
-    currentScope = scopes.get(ctx).get();
+  // the cache only serves input files
+  CompileCache cache(cacheDirectory, cacheMegabytes * 1024 * 1024, options.staticInline ? "static-inline" : "");
+  if (!inputs.empty()) {
+    int status = compileBatch(inputs, output, options, jobs, useCache ? &cache : nullptr, stats);
+    if (cacheStats) {
+      printCacheStats(cache);
+    }
+    reportPasses();
+    return status;
   }
-
-  void exitBlockStatement(TmplangParser::BlockStatementContext *ctx) override {
-    currentScope = currentScope->parent;
+  if (cacheStats) {
+    printCacheStats(cache);
+    return 0;
   }
 
-  void enterIfStatement(TmplangParser::IfStatementContext *ctx) override {
-    currentScope = scopes.get(ctx).get();
+  SourceBuffer source;
+  if (!source.loadFd(0)) {
+    std::cerr << "can't read the input\n";
+    return 1;
   }
-
-  void enterVarDeclStatement(TmplangParser::VarDeclStatementContext *ctx) override {
-    Type *varType = currentScope->resolve(ctx->identifier()->getText());
-    Type *inferredType = applyUnifier(varType, subst);
-    std::cout << ctx->identifier()->getText() << ": ";
-    inferredType->print();
-    std::cout << "\n";
+  int fd = output.empty() ? 1 : open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    std::cerr << "can't write the output\n";
+    return 1;
   }
-};
-
-
-int main(int argc, const char *argv[]) {
-  ANTLRInputStream input(std::cin);
-  TmplangLexer lexer(&input);
-  CommonTokenStream tokens(&lexer);
-  TmplangParser parser(&tokens);
-
-  tree::ParseTree *tree = parser.file();
-
-  SymbolTableGenerator symgen;
-  tree::ParseTreeWalker::DEFAULT.walk(&symgen, tree);
-
-  auto symbolTable = std::move(symgen.scopes);
-
-  TypeEquationGenerater eqgen(symbolTable);
-  tree::ParseTreeWalker::DEFAULT.walk(&eqgen, tree);
-
-  for (auto& eq : eqgen.equations) {
-    std::cout << "equation ===========\n";
-    eq.left->print();
-    std::cout << "  ==  ";
-    eq.right->print();
-    std::cout << '\n';
+  std::string error;
+  bool failed;
+  {
+    ThreadPool pool(jobs);
+    FdSink sink(fd);
+    error = emitSource(source.text(), options, &pool, nullptr, stats, sink);
+    failed = sink.failed();
   }
-
-  auto subst = unifyAllEquations(eqgen.equations);
-  if (!subst.has_value()) {
-    std::cout << "Type inference failed...\n";
-    return 0;
+  if ((fd != 1 && close(fd) != 0) || (failed && error.empty())) {
+    error = "can't write the output";
   }
-  else {
-    std::cout << "Type inference succeeded!!\n";
-    for (auto kv : subst.value()) {
-      std::cout << "Type var id: " << kv.first << " -> ";
-      kv.second->print();
-      std::cout << "\n";
+  if (!error.empty()) {
+    std::cerr << error << "\n";
+    if (fd != 1) {
+      unlink(output.c_str());
     }
   }
-
-  std::cout << "---------------------------\n";
-  std::cout << "Type inference result\n";
-  Checker checker(symbolTable, subst.value());
-  tree::ParseTreeWalker::DEFAULT.walk(&checker, tree);
-
-  std::cout << "\n";
-  std::cout << "transpiled result: \n\n";
-  Transpiler transpiler(symbolTable, subst.value());
-  transpiler.visit(tree);
-
-  std::cout << transpiler.oss.str();
-  return 0;
+  reportPasses();
+  return error.empty() ? 0 : 1;
 }
@@ -0,0 +1,19 @@
+int some_function2(int param1, int param2){
+  int var2_block_1;
+
+  var2_block_1 = param2 * 444;
+  return var2_block_1;
+}
+
+int some_function1(int a, int b){
+
+  return 15321552 / a - 214501728;
+}
+
+int other_function(int param){
+  int c_block_1;
+
+  c_block_1 = param + 777;
+  return c_block_1 - 10;
+}
+